@@ -0,0 +1,33 @@
+/* ******************************************************************
+   Allocation counting, for the macro-benchmarks.  Linked into a
+   protocol with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, it
+   counts every allocation made by the emulator and by the protocol,
+   which the performance report of -P gives per msg delivered.
+   Without it, the report has no allocation count.
+**********************************************************************/
+
+#include <stddef.h>
+
+long long nallocs = 0; /* calls to malloc(), calloc() and realloc() */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED); /* -p: several threads */
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	__atomic_add_fetch(&nallocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(p, size);
+}
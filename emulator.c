@@ -0,0 +1,4401 @@
+#define _GNU_SOURCE /* sendmmsg() and recvmmsg() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <linux/filter.h>
+
+#include "emulator.h"
+
+/* possible events: */
+#define TIMER_INTERRUPT 0
+#define FROM_LAYER5 1
+#define FROM_LAYER3 2
+#define TO_WIRE 3 /* -b udp: a packet the shim holds, sent at its arrival time */
+#define APP_READ 4 /* -W: the application reads a msg from a receive buffer */
+
+/* backends, chosen with -b */
+#define BACKEND_SIM 0 /* the simulated channel */
+#define BACKEND_UDP 1 /* UDP on loopback, in real time */
+#define BACKEND_URING 2 /* the same through io_uring */
+
+/*****************************************************************
+***************** NETWORK EMULATION CODE STARTS BELOW ***********
+The code below emulates the layer 3 and below network environment:
+  - emulates the tranmission and delivery (possibly with bit-level corruption
+    and packet loss) of packets across the layer 3/4 interface
+  - handles the starting/stopping of a timer, and generates timer
+    interrupts (resulting in calling students timer handler).
+  - generates message to be sent (passed from later 5 to 4)
+
+THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
+THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
+OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
+the emulator, you're welcome to look at the code - but again, you should have
+to, and you defeinitely should not have to modify
+******************************************************************/
+
+struct event
+{
+	float evtime;		/* event time */
+	int evtype;			/* event type code */
+	int eventity;		/* entity where event occurs */
+	int evflow;			/* flow of the entity */
+	int evcount;		/* msgs given, for FROM_LAYER5 */
+	struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
+	int heapindex;		/* position in the event list, or in its timer wheel slot */
+	int wheelslot;		/* -b udp: slot of the timer wheel */
+	long long evseq;	/* order in which the event was inserted */
+};
+/* the state of the simulation of a group of flows is thread-local, */
+/* so that with -p each thread simulates its own (see PARALLEL below) */
+_Thread_local struct event **evlist = NULL; /* the event list, a heap of nevents events */
+_Thread_local int nevents = 0;				/* number of events in the event list */
+_Thread_local int evlistsize = 0;			/* room in evlist */
+_Thread_local long long nevseq = 0;			/* events inserted so far */
+struct protocol *protocol;					/* the protocol being simulated */
+int nflows = 1;								/* -n: number of A-to-B flows sharing the channel */
+_Thread_local int curflow = 0;				/* flow of the entity being called */
+struct event **timers;						/* running timer of each entity of each flow, or NULL */
+_Thread_local int ninflight[2];				/* packets in the channel towards each entity */
+_Thread_local float lastarrival[2];			/* latest arrival scheduled towards each entity */
+int backend = BACKEND_SIM;					/* -b: what carries the packets */
+int connmsgs = 0;							/* -C: msgs per connection, 0 for one endless transfer */
+
+void init(void);
+void generate_next_arrival(void);
+struct event *nextevent(void);
+void insertevent(struct event *p);
+void heapset(int i, struct event *p);
+void channel_send(int AorB, struct pkt *packet);
+int channel_carry(int AorB, struct pkt *packet, int copy);
+float jimsrand(void);
+float jimsrand_r(unsigned int *seed);
+int eventbefore(struct event *p, struct event *q);
+void udp_write_stats(FILE *out);
+int msgs_max(void);
+
+// initialize globals
+int TRACE = 1;						 /* for my debugging */
+_Thread_local int nsim = 0;			 /* number of messages from 5 to 4 so far */
+int nsimmax = 0;					 /* number of msgs to generate, then stop */
+_Thread_local float simtime = 0.000; /* not "time", which would hide time() of <time.h> */
+float lossprob;	   /* probability that a packet is dropped  */
+float corruptprob; /* probability that one bit is packet is flipped */
+float lambda;	   /* arrival rate of messages from layer 5 */
+
+/****************************** PROFILING *****************************/
+/* With -X <file>, each event simulated is timed and its time charged */
+/* to its type and entity: a FROM_LAYER3 event at B costs B_input(),   */
+/* the protocol's printing included, plus all the emulator does for   */
+/* it (packets given to layer 3, timers, deliveries).  The event list */
+/* counts its inserts and removals, the heap levels they move events  */
+/* through and the time they take, which is part of the time of the   */
+/* events doing them; with -b udp, the timer wheel counts the entries */
+/* it looks at.  Time is read from the TSC on x86-64, in ticks whose   */
+/* rate the report gives, and in ns elsewhere.  The report is written  */
+/* as JSON at exit.  Without -X, the cost is one test per event and    */
+/* per operation on the event list.                                    */
+/**********************************************************************/
+
+#define NEVTYPES 5 /* TIMER_INTERRUPT .. APP_READ */
+
+struct profile
+{
+	long long count[NEVTYPES][2]; /* events simulated, by type and entity */
+	long long ticks[NEVTYPES][2]; /* time spent simulating them */
+	long long ninsert, nremove;	  /* operations on the event list */
+	long long nsteps;			  /* heap levels they moved events through */
+	long long listticks;		  /* time spent in them */
+	long long nwheelsteps;		  /* -b udp: timer wheel entries looked at */
+};
+
+int profiling = 0;			  /* -X: profile the run */
+char *profname = NULL;		  /* where to write the report */
+long long prof_start;		  /* ticks when the run started */
+struct timespec prof_started; /* and wall time */
+
+/* the time in ticks */
+long long prof_ticks(void)
+{
+#if defined(__x86_64__)
+	return (long long)__builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+void prof_merge(struct profile *to, struct profile *from)
+{
+	int t, e;
+
+	for (t = 0; t < NEVTYPES; t++)
+		for (e = A; e <= B; e++)
+		{
+			to->count[t][e] += from->count[t][e];
+			to->ticks[t][e] += from->ticks[t][e];
+		}
+	to->ninsert += from->ninsert;
+	to->nremove += from->nremove;
+	to->nsteps += from->nsteps;
+	to->listticks += from->listticks;
+	to->nwheelsteps += from->nwheelsteps;
+}
+
+void prof_write(char *filename, struct profile *p)
+{
+	static char *names[NEVTYPES] = {"timer_interrupt", "from_layer5", "from_layer3", "to_wire", "app_read"};
+	long long ticks = prof_ticks() - prof_start, ops = p->ninsert + p->nremove;
+	struct timespec now;
+	double wall;
+	FILE *out = fopen(filename, "w");
+	int t, e, first = 1;
+
+	if (out == NULL)
+	{
+		perror(filename);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wall = now.tv_sec - prof_started.tv_sec + (now.tv_nsec - prof_started.tv_nsec) / 1e9;
+#if defined(__x86_64__)
+	fprintf(out, "{\"clock\": \"tsc\", ");
+#else
+	fprintf(out, "{\"clock\": \"ns\", ");
+#endif
+	fprintf(out, "\"wall_seconds\": %f, \"ticks_per_second\": %f,\n  \"events\": [",
+			wall, wall > 0 ? ticks / wall : 0.0);
+	for (t = 0; t < NEVTYPES; t++)
+		for (e = A; e <= B; e++)
+			if (p->count[t][e] > 0)
+			{
+				fprintf(out, "%s\n    {\"type\": \"%s\", \"entity\": \"%c\", \"count\": %lld, \"ticks\": %lld, \"ticks_per_event\": %f}",
+						first ? "" : ",", names[t], e == A ? 'A' : 'B', p->count[t][e], p->ticks[t][e],
+						(double)p->ticks[t][e] / p->count[t][e]);
+				first = 0;
+			}
+	fprintf(out, "],\n  \"event_list\": {\"inserts\": %lld, \"removals\": %lld, \"steps\": %lld, \"steps_per_op\": %f, \"ticks\": %lld, \"ticks_per_op\": %f},\n",
+			p->ninsert, p->nremove, p->nsteps, ops > 0 ? (double)p->nsteps / ops : 0.0,
+			p->listticks, ops > 0 ? (double)p->listticks / ops : 0.0);
+	fprintf(out, "  \"timer_wheel\": {\"steps\": %lld}}\n", p->nwheelsteps);
+	fclose(out);
+}
+
+/****************************** STATISTICS ****************************/
+/* End-of-run statistics, written as JSON when the simulator is run    */
+/* with -s <file> ("-" for stdout).                                    */
+/* In each flow, each entity's msgs from layer 5 form a stream; a      */
+/* stream remembers the submit time and fill letter of its msgs until  */
+/* they are both sent and delivered.  The protocol tells which packets */
+/* carry a msg by giving them with tolayer3_msg(), which also tells a  */
+/* first transmission of the next unsent msg from a retransmission;    */
+/* packets given with tolayer3() carry none.  Deliveries that          */
+/* verify_deliver() matches to a msg of the stream are timed from its  */
+/* submit.                                                             */
+/* Latency is kept in an HDR-style histogram: values below             */
+/* HIST_SUB_COUNT ticks are exact, larger ones are bucketed by power   */
+/* of two with HIST_SUB_COUNT/2 linear sub-buckets each (~1%).         */
+/**********************************************************************/
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)
+#define HIST_BUCKETS 48
+#define HIST_SIZE (HIST_SUB_COUNT + HIST_BUCKETS * HIST_HALF_COUNT)
+#define HIST_TICKS 1000.0 /* histogram ticks per simulated time unit */
+#define VERIFY_WINDOW 13  /* msgs searched on each side of the next expected one */
+
+struct histogram
+{
+	long long counts[HIST_SIZE];
+	long long total;
+	long long min, max; /* in ticks */
+	double sum;			/* in time units */
+};
+
+struct submit
+{
+	float time;	 /* time the msg was given by layer 5 */
+	char letter; /* its fill letter */
+};
+
+/* the msgs given to one entity of one flow */
+struct stream
+{
+	struct submit *ring;	 /* msgs not yet both sent and delivered */
+	long long size;			 /* ring capacity, a power of two */
+	long long nsubmit;		 /* index of the next msg from layer 5 */
+	long long nsend;		 /* index of the next msg not yet sent */
+	long long ndeliver;		 /* index of the next msg expected in order */
+	unsigned long long seen; /* bit i set: msg ndeliver-1-i was delivered */
+	long long nunique;		 /* msgs delivered at the peer at least once */
+	long long nacked;		 /* index of the next msg not yet acknowledged */
+	int refused;			 /* app_send() would have blocked since writable() */
+};
+
+/* totals over all flows of the data sent by one entity */
+struct tally
+{
+	long long nsubmit;	   /* msgs given by layer 5 */
+	long long ndelivered;  /* deliveries at the peer */
+	long long nunique;	   /* of those, first deliveries of a msg */
+	long long nin_order;   /* ... that were the next msg expected */
+	long long nreorder;	   /* ... that filled an earlier gap */
+	long long ngap;		   /* msgs skipped by a later delivery, not yet filled */
+	long long nduplicate;  /* deliveries of an already delivered msg */
+	long long ncorrupt;	   /* deliveries that are not 20 copies of a fill letter */
+	long long nunexpected; /* deliveries of a letter not near the next msg */
+	long long nacked;	   /* msgs the protocol reported acknowledged */
+	long long nwouldblock; /* app_send() calls refused for lack of credit */
+	long long noverflow;   /* deliveries to a full receive buffer, dropped */
+	long long nupdate;	   /* receive buffers reopened for a window update */
+	struct histogram latency;
+};
+
+struct stats
+{
+	int nsent[2];			/* packets given to layer 3 by each entity */
+	int nretransmit[2];		/* of those, packets repeating a msg already sent */
+	int ntimerstart[2];		/* timers started */
+	int ntimerstop[2];		/* timers stopped before firing */
+	int ntimerfired[2];		/* timer interrupts delivered */
+	float busy[2];			/* time the channel towards each entity carried a packet */
+	float busy_until[2];	/* end of the last busy period of that channel */
+	struct tally tally[2];	/* data sent by each entity */
+	int ntolayer3;			/* number sent into layer 3 */
+	int nlost;				/* number lost in media */
+	int ncorrupt;			/* number corrupted by media*/
+	long long nflipped;		/* bits flipped by media, with -E */
+	int nreordered;			/* held back by media, with -R */
+	int nduplicated;		/* duplicated by media, with -D */
+	long long nconnections; /* -C: connections closed */
+	long long nsimulated;	/* events simulated, and datagrams received with -b udp */
+	struct histogram setup;		 /* from opening a connection to established */
+	struct histogram completion; /* ... to all its msgs acknowledged */
+	struct histogram lifetime;	 /* ... to closed, TIME_WAIT included */
+	struct profile profile;		 /* -X */
+};
+_Thread_local struct stats stats; /* of the flows simulated by this thread */
+struct stream *streams;			  /* msgs given to each entity of each flow */
+char *statsfile = NULL; /* -s: where to write the JSON report */
+int verify_strict = 0;	/* -v: exit with status 1 if a delivery check failed */
+
+/* the stream of msgs given to entity AorB of flow */
+struct stream *stream_of(int flow, int AorB)
+{
+	return &streams[2 * flow + AorB];
+}
+
+int hist_index(long long value)
+{
+	int bucket;
+
+	if (value < HIST_SUB_COUNT)
+		return (int)value;
+	for (bucket = 0; (value >> bucket) >= HIST_SUB_COUNT; bucket++)
+		;
+	if (bucket > HIST_BUCKETS)
+		return HIST_SIZE - 1;
+	return HIST_SUB_COUNT + (bucket - 1) * HIST_HALF_COUNT + (int)(value >> bucket) - HIST_HALF_COUNT;
+}
+
+/* highest value that maps to the same histogram slot as index */
+long long hist_value(int index)
+{
+	int bucket;
+
+	if (index < HIST_SUB_COUNT)
+		return index;
+	bucket = (index - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+	return ((long long)((index - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT + 1) << bucket) - 1;
+}
+
+void hist_record(struct histogram *h, double value)
+{
+	long long ticks = (long long)(value * HIST_TICKS + 0.5);
+
+	if (ticks < 0)
+		ticks = 0;
+	h->counts[hist_index(ticks)]++;
+	if (h->total == 0 || ticks < h->min)
+		h->min = ticks;
+	if (ticks > h->max)
+		h->max = ticks;
+	h->total++;
+	h->sum += value;
+}
+
+/* value (in time units) at or below which a fraction p of the samples lie */
+double hist_percentile(struct histogram *h, double p)
+{
+	long long rank, seen = 0;
+	int i;
+
+	if (h->total == 0)
+		return 0.0;
+	rank = (long long)(p * h->total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_SIZE; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= rank)
+			break;
+	}
+	if (hist_value(i) > h->max)
+		return h->max / HIST_TICKS;
+	return hist_value(i) / HIST_TICKS;
+}
+
+/* add the samples of histogram g to h */
+void hist_merge(struct histogram *h, struct histogram *g)
+{
+	int i;
+
+	for (i = 0; i < HIST_SIZE; i++)
+		h->counts[i] += g->counts[i];
+	if (g->total > 0 && (h->total == 0 || g->min < h->min))
+		h->min = g->min;
+	if (g->max > h->max)
+		h->max = g->max;
+	h->total += g->total;
+	h->sum += g->sum;
+}
+
+/* add the statistics of another thread to those of this one */
+void stats_merge(struct stats *from)
+{
+	int e;
+
+	stats.ntolayer3 += from->ntolayer3;
+	stats.nlost += from->nlost;
+	stats.ncorrupt += from->ncorrupt;
+	stats.nflipped += from->nflipped;
+	stats.nreordered += from->nreordered;
+	stats.nduplicated += from->nduplicated;
+	stats.nconnections += from->nconnections;
+	stats.nsimulated += from->nsimulated;
+	prof_merge(&stats.profile, &from->profile);
+	hist_merge(&stats.setup, &from->setup);
+	hist_merge(&stats.completion, &from->completion);
+	hist_merge(&stats.lifetime, &from->lifetime);
+	for (e = A; e <= B; e++)
+	{
+		stats.nsent[e] += from->nsent[e];
+		stats.nretransmit[e] += from->nretransmit[e];
+		stats.ntimerstart[e] += from->ntimerstart[e];
+		stats.ntimerstop[e] += from->ntimerstop[e];
+		stats.ntimerfired[e] += from->ntimerfired[e];
+		stats.busy[e] += from->busy[e];
+		if (from->busy_until[e] > stats.busy_until[e])
+			stats.busy_until[e] = from->busy_until[e];
+		stats.tally[e].nsubmit += from->tally[e].nsubmit;
+		stats.tally[e].nacked += from->tally[e].nacked;
+		stats.tally[e].nwouldblock += from->tally[e].nwouldblock;
+		stats.tally[e].noverflow += from->tally[e].noverflow;
+		stats.tally[e].nupdate += from->tally[e].nupdate;
+		stats.tally[e].ndelivered += from->tally[e].ndelivered;
+		stats.tally[e].nunique += from->tally[e].nunique;
+		stats.tally[e].nin_order += from->tally[e].nin_order;
+		stats.tally[e].nreorder += from->tally[e].nreorder;
+		stats.tally[e].ngap += from->tally[e].ngap;
+		stats.tally[e].nduplicate += from->tally[e].nduplicate;
+		stats.tally[e].ncorrupt += from->tally[e].ncorrupt;
+		stats.tally[e].nunexpected += from->tally[e].nunexpected;
+		hist_merge(&stats.tally[e].latency, &from->tally[e].latency);
+	}
+}
+
+/* msg index of stream s, which must still be in the ring */
+struct submit *stream_msg(struct stream *s, long long index)
+{
+	return &s->ring[index & (s->size - 1)];
+}
+
+/* layer 5 is giving a msg to entity AorB of the current flow */
+void stats_submit(int AorB, char letter)
+{
+	struct stream *s = stream_of(curflow, AorB);
+	long long oldest = s->ndeliver - VERIFY_WINDOW; /* verify_deliver() looks this far back */
+	struct submit *grown;
+	long long i;
+
+	if (s->nsend < oldest)
+		oldest = s->nsend;
+	if (oldest < 0)
+		oldest = 0;
+	if (s->nsubmit - oldest == s->size)
+	{
+		grown = (struct submit *)malloc(sizeof(struct submit) * (s->size ? 2 * s->size : 64));
+		for (i = oldest; i < s->nsubmit; i++)
+			grown[i & ((s->size ? 2 * s->size : 64) - 1)] = *stream_msg(s, i);
+		free(s->ring);
+		s->ring = grown;
+		s->size = s->size ? 2 * s->size : 64;
+	}
+	stream_msg(s, s->nsubmit)->time = simtime;
+	stream_msg(s, s->nsubmit)->letter = letter;
+	s->nsubmit++;
+	stats.tally[AorB].nsubmit++;
+}
+
+/* what a packet given to layer 3 carries, for stats_send() */
+#define SEND_CONTROL 0 /* no msg: tolayer3() */
+#define SEND_FIRST 1   /* the next msg not yet sent: tolayer3_msg() */
+#define SEND_RESEND 2  /* a msg sent before: tolayer3_msg() with resend */
+
+/* AorB of the current flow gave a packet carrying what to layer 3 */
+void stats_send(int AorB, int what)
+{
+	struct stream *s = stream_of(curflow, AorB);
+
+	stats.nsent[AorB]++;
+	if (what == SEND_RESEND)
+		stats.nretransmit[AorB]++;
+	else if (what == SEND_FIRST && s->nsend < s->nsubmit)
+		s->nsend++;
+}
+
+/* a packet occupies the channel towards entity from now until arrival */
+void stats_channel(int entity, float arrival)
+{
+	float start = simtime > stats.busy_until[entity] ? simtime : stats.busy_until[entity];
+
+	if (arrival > start)
+	{
+		stats.busy[entity] += arrival - start;
+		stats.busy_until[entity] = arrival;
+	}
+}
+
+/*********************** DELIVERY VERIFICATION ************************/
+/* Every msg handed to tolayer5() is checked against the stream of msgs */
+/* its sender was given: it must be 20 copies of one fill letter, and   */
+/* the letter must be that of the next msg of the stream.  A letter     */
+/* found up to VERIFY_WINDOW msgs ahead skips a gap; one found behind   */
+/* is a duplicate if that msg was already delivered, or a reorder that  */
+/* fills the gap if it was not.  The only state is a few counters and   */
+/* a bitmap per stream, however many msgs are simulated.                */
+/**********************************************************************/
+
+void verify_report(int AorB, char *what, long long index)
+{
+	if (TRACE > 0)
+		printf("          TOLAYER5: %s at %c, msg %lld\n", what, AorB == A ? 'A' : 'B', index);
+}
+
+/* returns the index of the msg delivered in the stream of the peer */
+/* of AorB in the current flow, or -1 if it is not a new one        */
+long long verify_deliver(int AorB, char datasent[20])
+{
+	struct stream *s = stream_of(curflow, (AorB + 1) % 2);
+	struct tally *t = &stats.tally[(AorB + 1) % 2];
+	unsigned long long bit;
+	long long k;
+	int i;
+
+	t->ndelivered++;
+	for (i = 1; i < 20 && datasent[i] == datasent[0]; i++)
+		;
+	if (i < 20 || datasent[0] < 'a' || datasent[0] > 'z')
+	{
+		t->ncorrupt++;
+		verify_report(AorB, "corrupted payload", -1);
+		return -1;
+	}
+
+	/* the next msg expected, or a later one after a gap */
+	for (k = s->ndeliver; k < s->nsubmit && k < s->ndeliver + VERIFY_WINDOW; k++)
+		if (stream_msg(s, k)->letter == datasent[0])
+		{
+			if (k == s->ndeliver)
+				t->nin_order++;
+			else
+			{
+				t->ngap += k - s->ndeliver;
+				verify_report(AorB, "gap before", k);
+			}
+			s->seen = (s->seen << (k - s->ndeliver + 1)) | 1;
+			s->ndeliver = k + 1;
+			s->nunique++;
+			t->nunique++;
+			return k;
+		}
+
+	/* an earlier msg: delivered again, or late */
+	for (k = s->ndeliver - 1; k >= 0 && k >= s->ndeliver - VERIFY_WINDOW; k--)
+		if (stream_msg(s, k)->letter == datasent[0])
+		{
+			bit = 1ULL << (s->ndeliver - 1 - k);
+			if (s->seen & bit)
+			{
+				t->nduplicate++;
+				verify_report(AorB, "duplicate", k);
+				return -1;
+			}
+			s->seen |= bit;
+			t->ngap--;
+			t->nreorder++;
+			s->nunique++;
+			t->nunique++;
+			verify_report(AorB, "reordered", k);
+			return k;
+		}
+
+	t->nunexpected++;
+	verify_report(AorB, "unexpected msg", -1);
+	return -1;
+}
+
+/* number of failed checks on the data sent by entity from */
+long long verify_failures(int from)
+{
+	struct tally *t = &stats.tally[from];
+
+	return t->ngap + t->nreorder + t->nduplicate + t->ncorrupt + t->nunexpected;
+}
+
+void stats_write_timers(FILE *out, int AorB)
+{
+	fprintf(out, "{\"started\": %d, \"stopped\": %d, \"fired\": %d}",
+			stats.ntimerstart[AorB], stats.ntimerstop[AorB], stats.ntimerfired[AorB]);
+}
+
+void hist_write(FILE *out, struct histogram *h)
+{
+	fprintf(out, "{\"count\": %lld, \"min\": %f, \"mean\": %f, \"max\": %f, \"p50\": %f, \"p99\": %f, \"p999\": %f}",
+			h->total, h->min / HIST_TICKS, h->total ? h->sum / h->total : 0.0, h->max / HIST_TICKS,
+			hist_percentile(h, 0.50), hist_percentile(h, 0.99), hist_percentile(h, 0.999));
+}
+
+/* the data flow from entity from to its peer, over all flows */
+void stats_write_direction(FILE *out, int from)
+{
+	int to = (from + 1) % 2;
+	struct tally *s = &stats.tally[from];
+	struct histogram *h = &s->latency;
+	float busy = stats.busy[to];
+
+	/* the last busy period started by the end, but packets queued */
+	/* in the channel can keep it busy well after                   */
+	if (stats.busy_until[to] > simtime)
+		busy -= stats.busy_until[to] - simtime;
+	fprintf(out, "{\"submitted\": %lld, \"acked\": %lld, \"would_block\": %lld,\n",
+			s->nsubmit, s->nacked, s->nwouldblock);
+	fprintf(out, "    \"sent\": %d, \"retransmitted\": %d, \"retransmission_ratio\": %f,\n",
+			stats.nsent[from], stats.nretransmit[from],
+			stats.nsent[from] > 0 ? (double)stats.nretransmit[from] / stats.nsent[from] : 0.0);
+	fprintf(out, "    \"delivered\": %lld, \"unique\": %lld, \"goodput\": %f, \"utilization\": %f,\n",
+			s->ndelivered, s->nunique, simtime > 0 ? s->nunique * (double)MSGSIZE / simtime : 0.0,
+			simtime > 0 ? busy / simtime : 0.0);
+	fprintf(out, "    \"receive_buffer\": {\"overflows\": %lld, \"window_updates\": %lld},\n",
+			s->noverflow, s->nupdate);
+	fprintf(out, "    \"verify\": {\"in_order\": %lld, \"gaps\": %lld, \"reorders\": %lld, \"duplicates\": %lld, \"corrupt\": %lld, \"unexpected\": %lld, \"undelivered\": %lld},\n",
+			s->nin_order, s->ngap, s->nreorder, s->nduplicate, s->ncorrupt, s->nunexpected,
+			s->nsubmit - s->nunique - s->ngap);
+	fprintf(out, "    \"latency\": ");
+	hist_write(out, h);
+	fprintf(out, "}");
+}
+
+/* how evenly the A-to-B flows shared the channel: Jain's index of */
+/* the msgs each flow delivered, 1 when all delivered the same      */
+void stats_write_fairness(FILE *out)
+{
+	double sum = 0.0, squares = 0.0, x;
+	long long least = 0, most = 0;
+	int f;
+
+	for (f = 0; f < nflows; f++)
+	{
+		x = stream_of(f, A)->nunique;
+		sum += x;
+		squares += x * x;
+		if (f == 0 || x < least)
+			least = x;
+		if (x > most)
+			most = x;
+	}
+	fprintf(out, "{\"count\": %d, \"fairness\": %f, \"min_delivered\": %lld, \"max_delivered\": %lld}",
+			nflows, squares > 0 ? sum * sum / (nflows * squares) : 1.0, least, most);
+}
+
+/* goodput is in unique payload bytes per time unit, utilization the */
+/* fraction of time the channel carried at least one packet          */
+void stats_write(char *filename)
+{
+	FILE *out;
+
+	out = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+	if (out == NULL)
+	{
+		perror(filename);
+		return;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"time\": %f,\n", simtime);
+	fprintf(out, "  \"messages\": {\"max\": %d, \"from_layer5\": %d},\n", nsimmax, nsim);
+	fprintf(out, "  \"channel\": {\"to_layer3\": %d, \"lost\": %d, \"corrupted\": %d, \"bits_flipped\": %lld, \"reordered\": %d, \"duplicated\": %d},\n",
+			stats.ntolayer3, stats.nlost, stats.ncorrupt, stats.nflipped, stats.nreordered, stats.nduplicated);
+	fprintf(out, "  \"flows\": ");
+	stats_write_fairness(out);
+	fprintf(out, ",\n");
+	fprintf(out, "  \"A_to_B\": ");
+	stats_write_direction(out, A);
+	fprintf(out, ",\n  \"B_to_A\": ");
+	stats_write_direction(out, B);
+	fprintf(out, ",\n  \"timers\": {\"A\": ");
+	stats_write_timers(out, A);
+	fprintf(out, ", \"B\": ");
+	stats_write_timers(out, B);
+	fprintf(out, "}");
+	if (connmsgs > 0)
+	{
+		fprintf(out, ",\n  \"connections\": {\"count\": %lld, \"msgs_each\": %d,\n    \"setup\": ",
+				stats.nconnections, connmsgs);
+		hist_write(out, &stats.setup);
+		fprintf(out, ",\n    \"completion\": ");
+		hist_write(out, &stats.completion);
+		fprintf(out, ",\n    \"lifetime\": ");
+		hist_write(out, &stats.lifetime);
+		fprintf(out, "}");
+	}
+	if (backend != BACKEND_SIM)
+	{
+		fprintf(out, ",\n  \"udp\": ");
+		udp_write_stats(out);
+	}
+	fprintf(out, "\n}\n");
+
+	if (out != stdout)
+		fclose(out);
+}
+
+/*************************** TIME-SERIES SAMPLES **********************/
+/* With -i <interval>, the main loop takes a sample of the simulator   */
+/* state every <interval> time units, just before the first event at   */
+/* or after each sample time.  Samples are kept column by column and   */
+/* written at exit with -S <file>: as CSV if the name ends in ".csv",  */
+/* otherwise as binary columns in host byte order:                     */
+/*   char magic[8] = "SAMPLES1", long long nrows,                      */
+/*   float time[nrows], int inflight_to_B[nrows],                      */
+/*   int inflight_to_A[nrows], int events[nrows],                      */
+/*   long long delivered_bytes[nrows], int retransmits[nrows]          */
+/* The protocols keep no congestion window, so there is no cwnd column.*/
+/**********************************************************************/
+
+struct samples
+{
+	long long n, size;
+	float *time;
+	int *inflight[2];		  /* packets in the channel towards each entity */
+	int *events;			  /* events in the event list */
+	long long *delivered;	  /* unique payload bytes delivered, both ways */
+	int *retransmits;		  /* packets retransmitted, both entities */
+};
+struct samples samples;
+float sample_interval = 0.0; /* -i: time between samples, 0 for none */
+float sample_next = 0.0;	 /* time of the next sample */
+char *samplefile = NULL;	 /* -S: where to write the samples */
+
+void *grow(void *column, long long size, int width)
+{
+	void *grown = realloc(column, size * width);
+
+	if (grown == NULL)
+	{
+		printf("INTERNAL PANIC: out of memory for samples\n");
+		exit(1);
+	}
+	return grown;
+}
+
+void sample_take(float when)
+{
+	struct samples *s = &samples;
+
+	if (s->n == s->size)
+	{
+		s->size = s->size ? 2 * s->size : 1024;
+		s->time = grow(s->time, s->size, sizeof(float));
+		s->inflight[A] = grow(s->inflight[A], s->size, sizeof(int));
+		s->inflight[B] = grow(s->inflight[B], s->size, sizeof(int));
+		s->events = grow(s->events, s->size, sizeof(int));
+		s->delivered = grow(s->delivered, s->size, sizeof(long long));
+		s->retransmits = grow(s->retransmits, s->size, sizeof(int));
+	}
+	s->time[s->n] = when;
+	s->inflight[A][s->n] = ninflight[A];
+	s->inflight[B][s->n] = ninflight[B];
+	s->events[s->n] = nevents;
+	s->delivered[s->n] = (stats.tally[A].nunique + stats.tally[B].nunique) * MSGSIZE;
+	s->retransmits[s->n] = stats.nretransmit[A] + stats.nretransmit[B];
+	s->n++;
+}
+
+/* take the samples due up to the current time */
+void sample_until(float now)
+{
+	while (sample_interval > 0 && sample_next <= now)
+	{
+		sample_take(sample_next);
+		sample_next += sample_interval;
+	}
+}
+
+void sample_write(char *filename)
+{
+	struct samples *s = &samples;
+	size_t len = strlen(filename);
+	FILE *out;
+	long long i;
+
+	out = fopen(filename, "wb");
+	if (out == NULL)
+	{
+		perror(filename);
+		return;
+	}
+	if (len >= 4 && strcmp(filename + len - 4, ".csv") == 0)
+	{
+		fprintf(out, "time,inflight_to_B,inflight_to_A,events,delivered_bytes,retransmits\n");
+		for (i = 0; i < s->n; i++)
+			fprintf(out, "%f,%d,%d,%d,%lld,%d\n", s->time[i], s->inflight[B][i], s->inflight[A][i],
+					s->events[i], s->delivered[i], s->retransmits[i]);
+	}
+	else
+	{
+		fwrite("SAMPLES1", 1, 8, out);
+		fwrite(&s->n, sizeof(long long), 1, out);
+		fwrite(s->time, sizeof(float), s->n, out);
+		fwrite(s->inflight[B], sizeof(int), s->n, out);
+		fwrite(s->inflight[A], sizeof(int), s->n, out);
+		fwrite(s->events, sizeof(int), s->n, out);
+		fwrite(s->delivered, sizeof(long long), s->n, out);
+		fwrite(s->retransmits, sizeof(int), s->n, out);
+	}
+	fclose(out);
+}
+
+/*************************** EVENT TRACE / REPLAY *********************/
+/* With -t <file>, every event taken from the event list and every     */
+/* channel decision made by tolayer3() is appended to a binary trace   */
+/* of fixed-size records after an 8-byte "EVTRACE3" magic.             */
+/* With -r <file>, a recorded trace is replayed: the n-th packet an    */
+/* entity gives to tolayer3() gets the loss, delay and corruption the  */
+/* n-th one got in the recorded run, whatever its flow, and msgs       */
+/* arrive from layer 5 at the recorded times and flows, so a changed   */
+/* protocol sees exactly the same channel.  With several flows, the    */
+/* arrivals still pending at the end are recorded too, as each flow    */
+/* replays the arrivals of the trace ahead of those simulated.         */
+/* When a replayed trace runs out, the random number generator takes   */
+/* over again.  Bit errors are recorded as the pattern that picks the  */
+/* bits, so a trace recorded with -E must be replayed with the same -E. */
+/**********************************************************************/
+
+#define TRACE_TIMER 'T'	 /* timer interrupt taken from the event list */
+#define TRACE_LAYER5 '5' /* msg arrival from layer 5 taken from the event list */
+#define TRACE_LAYER3 '3' /* packet arrival taken from the event list */
+#define TRACE_SEND 'S'	 /* channel decision for a packet given to tolayer3() */
+#define TRACE_READ 'R'	 /* -W: a read of the application taken from the event list */
+
+/* channel decisions */
+#define CHANNEL_OK 0
+#define CHANNEL_LOST 1
+#define CHANNEL_CORRUPT_PAYLOAD 2
+#define CHANNEL_CORRUPT_SEQNUM 3
+#define CHANNEL_CORRUPT_ACKNUM 4
+#define CHANNEL_CORRUPT_BITS 5 /* -E: bits flipped anywhere after the flow */
+
+/* and what else happens to the packet */
+#define CHANNEL_REORDER 1	/* -R: held back, later packets overtake it */
+#define CHANNEL_DUPLICATE 2 /* -D: a copy follows, with a decision of its own */
+
+struct trace_record
+{
+	float time;	   /* event time; time of the send for TRACE_SEND */
+	char kind;	   /* TRACE_* */
+	char entity;   /* entity where the event occurs, sender for TRACE_SEND */
+	char decision; /* CHANNEL_* for TRACE_SEND */
+	char flags;	   /* CHANNEL_REORDER and CHANNEL_DUPLICATE for TRACE_SEND */
+	int flow;	/* flow of the entity */
+	int seqnum; /* of the packet, if any; msgs given, for TRACE_LAYER5 */
+	int acknum;
+	float delay;	   /* for TRACE_SEND, arrival time beyond 1 after the previous one */
+	unsigned int bits; /* for CHANNEL_CORRUPT_BITS, the pattern of the flipped bits */
+};
+
+/* a read position in a replayed trace */
+struct replay
+{
+	FILE *file;
+	struct trace_record rec;
+};
+
+FILE *tracefile = NULL;					/* -t: trace being recorded */
+char *replayname = NULL;				/* -r: trace being replayed */
+struct replay replay_send[2];			/* next channel decision for each sender */
+struct replay replay_arrival;			/* next msg arrival from layer 5 */
+
+void trace_open(char *filename)
+{
+	tracefile = fopen(filename, "wb");
+	if (tracefile == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	setvbuf(tracefile, NULL, _IOFBF, 1 << 16);
+	fwrite("EVTRACE3", 1, 8, tracefile);
+}
+
+void trace_write(char kind, int entity, int flow, struct pkt *packet, int decision, int flags, float delay, unsigned int bits)
+{
+	struct trace_record rec;
+
+	if (tracefile == NULL)
+		return;
+	memset(&rec, 0, sizeof(rec));
+	rec.time = simtime;
+	rec.kind = kind;
+	rec.entity = entity;
+	rec.flow = flow;
+	rec.decision = decision;
+	rec.flags = flags;
+	if (packet != NULL)
+	{
+		rec.seqnum = packet->seqnum;
+		rec.acknum = packet->acknum;
+	}
+	rec.delay = delay;
+	rec.bits = bits;
+	fwrite(&rec, sizeof(rec), 1, tracefile);
+}
+
+/* record an event taken from the event list */
+void trace_event(struct event *e)
+{
+	struct pkt count = {0};
+
+	if (e->evtype == TIMER_INTERRUPT)
+		trace_write(TRACE_TIMER, e->eventity, e->evflow, NULL, CHANNEL_OK, 0, 0.0, 0);
+	else if (e->evtype == FROM_LAYER5)
+	{
+		count.seqnum = e->evcount;
+		trace_write(TRACE_LAYER5, e->eventity, e->evflow, &count, CHANNEL_OK, 0, 0.0, 0);
+	}
+	else if (e->evtype == APP_READ)
+		trace_write(TRACE_READ, e->eventity, e->evflow, NULL, CHANNEL_OK, 0, 0.0, 0);
+	else
+		trace_write(TRACE_LAYER3, e->eventity, e->evflow, e->pktptr, CHANNEL_OK, 0, 0.0, 0);
+}
+
+/* record the msg arrivals left in the event list, earliest first */
+void trace_pending(void)
+{
+	struct event **pending, *e;
+	int i, j, n = 0;
+
+	if (tracefile == NULL)
+		return;
+	pending = (struct event **)malloc(nevents * sizeof(struct event *));
+	for (i = 0; i < nevents; i++)
+	{
+		if (evlist[i]->evtype != FROM_LAYER5)
+			continue;
+		e = evlist[i];
+		for (j = n++; j > 0 && eventbefore(e, pending[j - 1]); j--)
+			pending[j] = pending[j - 1];
+		pending[j] = e;
+	}
+	for (i = 0; i < n; i++)
+		trace_event(pending[i]);
+	free(pending);
+}
+
+void replay_open(struct replay *r, char *filename)
+{
+	char magic[8];
+
+	r->file = fopen(filename, "rb");
+	if (r->file == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	if (fread(magic, 1, 8, r->file) != 8 || memcmp(magic, "EVTRACE3", 8) != 0)
+	{
+		fprintf(stderr, "%s: not an event trace\n", filename);
+		exit(1);
+	}
+	setvbuf(r->file, NULL, _IOFBF, 1 << 16);
+}
+
+/* advance r to the next record of the given kind and entity (-1 for any); */
+/* returns 0, and stops replaying from r, at the end of the trace          */
+int replay_next(struct replay *r, char kind, int entity)
+{
+	if (r->file == NULL)
+		return 0;
+	while (fread(&r->rec, sizeof(r->rec), 1, r->file) == 1)
+		if (r->rec.kind == kind && (entity < 0 || r->rec.entity == entity))
+			return 1;
+	fclose(r->file);
+	r->file = NULL;
+	if (TRACE > 0)
+		printf("          REPLAY: trace exhausted, using random numbers\n");
+	return 0;
+}
+/*************************** ARRIVAL PROCESSES ************************/
+/* How msgs come from layer 5 to each flow, chosen with -a:            */
+/*   uniform   inter-arrival times uniform on [0, 2*lambda] (default)  */
+/*   poisson   exponential inter-arrival times of mean lambda          */
+/*   pareto    on/off: bursts of msgs lambda/2 apart, separated by     */
+/*             silences; bursts and silences last a Pareto distributed */
+/*             time of shape PARETO_SHAPE and mean PARETO_BURST*lambda/2 */
+/*   saturate  the sender always has msgs waiting: it is given         */
+/*             SATURATE_BACKLOG at the start, and whenever no more     */
+/*             than half of that is left unsent, an arrival tops it up */
+/* With -f <file>, msgs come instead at the times of the lines         */
+/* "time size [flow]" of the file, which is read at the start: size    */
+/* bytes make size/MSGSIZE msgs (rounded up), given to A of the flow   */
+/* (0 if none is named) at once.  Lines must be in time order.         */
+/* An arrival event gives evcount msgs, so a trace record or a top-up  */
+/* costs one event however many msgs it carries, and a pareto burst    */
+/* is drawn once for all its msgs.                                     */
+/**********************************************************************/
+
+#define ARRIVAL_UNIFORM 0
+#define ARRIVAL_POISSON 1
+#define ARRIVAL_PARETO 2
+#define ARRIVAL_SATURATE 3
+#define ARRIVAL_TRACE 4
+
+#define PARETO_SHAPE 1.5
+#define PARETO_BURST 20 /* mean msgs in a burst, about */
+#define SATURATE_BACKLOG 64
+
+/* msgs of an arrival trace line */
+struct arrival
+{
+	float time;
+	int count;
+};
+
+/* the state of the arrival process of one flow */
+struct source
+{
+	long long left;		   /* pareto: msgs left in the current burst */
+	struct arrival *trace; /* -f: the arrivals of the flow */
+	int ntrace;
+	int next;	  /* the one to schedule next */
+	int pending;  /* saturate: a top-up is scheduled */
+	long long held[2]; /* msgs for each entity the generator holds for lack of credit */
+};
+
+char *arrival_names[] = {"uniform", "poisson", "pareto", "saturate", NULL};
+int arrival = ARRIVAL_UNIFORM; /* -a, or ARRIVAL_TRACE with -f */
+char *arrivalname = NULL;	   /* -f: the arrival trace */
+struct source *sources;		   /* of each flow */
+
+/* -a name: 1 if name is an arrival process */
+int arrival_parse(char *name)
+{
+	int i;
+
+	for (i = 0; arrival_names[i] != NULL; i++)
+		if (strcmp(name, arrival_names[i]) == 0)
+		{
+			arrival = i;
+			return 1;
+		}
+	return 0;
+}
+
+/* uniform on (0, 1], for inverse transforms */
+double uniform_open(unsigned int *seed)
+{
+	return 1.0 - jimsrand_r(seed) * (1.0 - DBL_EPSILON);
+}
+
+/* Pareto distributed with shape PARETO_SHAPE and the given mean */
+double pareto(unsigned int *seed, double mean)
+{
+	return mean * (PARETO_SHAPE - 1) / PARETO_SHAPE / pow(uniform_open(seed), 1 / PARETO_SHAPE);
+}
+
+/* time of the msg from layer 5 following one at time from, and the */
+/* entity it goes to, drawn from the random number stream of seed   */
+float arrival_after(float from, struct source *src, unsigned int *seed, int *entity)
+{
+	double x;
+
+	if (arrival == ARRIVAL_POISSON)
+		x = -lambda * log(uniform_open(seed));
+	else if (arrival == ARRIVAL_PARETO)
+	{
+		x = lambda / 2; /* bursts run at twice the mean rate */
+		if (src->left == 0) /* a silence, then a new burst */
+		{
+			src->left = (long long)(pareto(seed, PARETO_BURST * lambda / 2) / x) + 1;
+			x += pareto(seed, PARETO_BURST * lambda / 2);
+		}
+		src->left--;
+	}
+	else
+		x = lambda * jimsrand_r(seed) * 2; /* x is uniform on [0,2*lambda] */
+										   /* having mean of lambda        */
+	if (protocol->bidirectional && (jimsrand_r(seed) > 0.5))
+		*entity = B;
+	else
+		*entity = A;
+	return (float)(from + x);
+}
+
+/* read the arrival trace of -f into the sources of the flows */
+void arrival_load(char *filename)
+{
+	FILE *in = fopen(filename, "r");
+	char line[256];
+	struct source *src;
+	long long size;
+	float when;
+	int flow;
+
+	if (in == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		flow = 0;
+		if (sscanf(line, "%f %lld %d", &when, &size, &flow) < 2 || flow < 0 || flow >= nflows)
+			continue; /* blank or comment line, or no such flow */
+		src = &sources[flow];
+		if ((src->ntrace & (src->ntrace - 1)) == 0) /* full at powers of two */
+			src->trace = (struct arrival *)realloc(src->trace, (src->ntrace ? 2 * src->ntrace : 16) * sizeof(struct arrival));
+		src->trace[src->ntrace].time = when;
+		src->trace[src->ntrace].count = size > MSGSIZE ? (int)((size + MSGSIZE - 1) / MSGSIZE) : 1;
+		src->ntrace++;
+	}
+	fclose(in);
+}
+
+/* schedule count msgs from layer 5 to entity of the current flow */
+void arrival_schedule(float when, int entity, int count)
+{
+	struct event *evptr = (struct event *)malloc(sizeof(struct event));
+
+	evptr->evtime = when;
+	evptr->evtype = FROM_LAYER5;
+	evptr->eventity = entity;
+	evptr->evflow = curflow;
+	evptr->evcount = count;
+	insertevent(evptr);
+}
+
+/* saturate: top up the msgs waiting at sender AorB of the current */
+/* flow if no more than half are left unsent                       */
+void arrival_topup(int AorB)
+{
+	struct stream *s = stream_of(curflow, AorB);
+	struct source *src = &sources[curflow];
+	long long waiting = s->nsubmit - s->nsend + src->held[AorB];
+
+	if (arrival != ARRIVAL_SATURATE || AorB != A || src->pending || replayname != NULL ||
+		waiting > SATURATE_BACKLOG / 2)
+		return;
+	arrival_schedule(simtime, A, (int)(SATURATE_BACKLOG - waiting));
+	src->pending = 1;
+}
+
+/****************************** APPLICATION ***************************/
+/* Layer 5 gives msgs to the transport of an entity with app_send(),  */
+/* which never blocks: the msg is queued with the protocol, or        */
+/* APP_WOULDBLOCK is returned if the entity has no credit left.  With  */
+/* -q <msgs> each entity has that many credits; a msg takes one when   */
+/* queued and gives it back once the protocol reports it acknowledged  */
+/* with acked(), so a sender holds that many msgs at most, however     */
+/* small its window.  Without -q credits are unlimited, as in the      */
+/* original emulator.  After the entities of a flow have run, the      */
+/* application of an entity that was refused and has credit again is  */
+/* called back with writable(); acked msgs and deliveries to layer 5   */
+/* are called back as well, so the application never polls.           */
+/* Unless a protocol registers its own application, layer 5 is the     */
+/* generator below.  It holds the msgs it is refused, as a count since */
+/* their letters follow from their order, and gives them as credit     */
+/* comes back.                                                         */
+/* With -C <msgs>, A talks to B over short connections instead: the    */
+/* generator opens one with app_open(), gives it msgs msgs, closes it  */
+/* with app_close(), and opens the next as soon as the protocol        */
+/* reports the last one closed() and msgs are waiting.  A has no       */
+/* credit while its connection is not established.  Each connection    */
+/* is timed from its opening to established (its setup), to all its   */
+/* msgs acknowledged (its completion) and to closed, TIME_WAIT         */
+/* included (its lifetime).                                            */
+/**********************************************************************/
+
+#define CONN_CLOSED 0
+#define CONN_OPENING 1 /* the handshake is under way */
+#define CONN_OPEN 2
+#define CONN_CLOSING 3
+
+/* the connection from A to B of one flow, with -C */
+struct connection
+{
+	int state;		  /* CONN_* */
+	int left;		  /* msgs it still takes */
+	long long end;	  /* index in the stream of A of its last msg, plus 1 */
+	float opened;	  /* when it was opened */
+};
+
+int sendbuffer = 0;				 /* -q: credits of each entity, 0 for unlimited */
+struct connection *connections; /* of each flow */
+
+/* A of the current flow opens a connection to B */
+void app_open(void)
+{
+	struct connection *c = &connections[curflow];
+
+	c->state = CONN_OPENING;
+	c->left = connmsgs;
+	c->opened = simtime;
+	protocol->A_open();
+}
+
+/* A of the current flow closes its connection once its msgs are */
+/* acknowledged                                                  */
+void app_close(void)
+{
+	struct connection *c = &connections[curflow];
+
+	c->state = CONN_CLOSING;
+	c->end = stream_of(curflow, A)->nsubmit;
+	if (c->end == stream_of(curflow, A)->nacked)
+		hist_record(&stats.completion, simtime - c->opened);
+	protocol->A_close();
+}
+
+/* credits left to entity AorB of the current flow */
+int app_credits(int AorB)
+{
+	struct stream *s = stream_of(curflow, AorB);
+
+	if (connmsgs > 0 && AorB == A && connections[curflow].state != CONN_OPEN)
+		return 0;
+	if (sendbuffer == 0)
+		return INT_MAX;
+	return sendbuffer - (int)(s->nsubmit - s->nacked);
+}
+
+/* layer 5 gives message to entity AorB of the current flow; if queued, */
+/* *id (unless NULL) is the msg's place in the stream of the entity,    */
+/* the id acked() and delivered() name it by                            */
+int app_send(int AorB, struct msg message, long long *id)
+{
+	struct stream *s = stream_of(curflow, AorB);
+	int i;
+
+	if (app_credits(AorB) <= 0)
+	{
+		s->refused = 1;
+		stats.tally[AorB].nwouldblock++;
+		return APP_WOULDBLOCK;
+	}
+	if (TRACE > 2)
+	{
+		printf("          MAINLOOP: data given to student: ");
+		for (i = 0; i < 20; i++)
+			printf("%c", message.data[i]);
+		printf("\n");
+	}
+	if (id != NULL)
+		*id = s->nsubmit;
+	stats_submit(AorB, message.data[0]);
+	if (AorB == A)
+		protocol->A_output(message);
+	else
+		protocol->B_output(message);
+	return APP_QUEUED;
+}
+
+/* give the next msg of the generator to AorB of the current flow; */
+/* 0 if it was refused                                              */
+int generator_give(int AorB)
+{
+	struct connection *c = &connections[curflow];
+	struct msg msg2give;
+	int i, j;
+
+	/* fill in msg to give with string of same letter; */
+	/* letters run through the msgs of each flow       */
+	j = (stream_of(curflow, A)->nsubmit + stream_of(curflow, B)->nsubmit) % 26;
+	for (i = 0; i < 20; i++)
+		msg2give.data[i] = 97 + j;
+	if (app_send(AorB, msg2give, NULL) != APP_QUEUED)
+		return 0;
+	if (connmsgs > 0 && AorB == A && --c->left == 0)
+		app_close();
+	return 1;
+}
+
+/* a msg from layer 5 for AorB, given unless older ones are held */
+void generator_arrival(int AorB)
+{
+	struct source *src = &sources[curflow];
+
+	if (connmsgs > 0 && AorB == A && connections[curflow].state == CONN_CLOSED)
+		app_open();
+	if (src->held[AorB] > 0 || !generator_give(AorB))
+		src->held[AorB]++;
+}
+
+/* credit came back: give the held msgs while it lasts */
+void generator_writable(int AorB)
+{
+	struct source *src = &sources[curflow];
+
+	while (src->held[AorB] > 0 && generator_give(AorB))
+		src->held[AorB]--;
+}
+
+/* the connection is closed: open the next if msgs are waiting */
+void generator_closed(int AorB)
+{
+	if (AorB == A && sources[curflow].held[A] > 0)
+		app_open();
+}
+
+struct application generator = {
+	.arrival = generator_arrival,
+	.writable = generator_writable,
+	.closed = generator_closed,
+};
+struct application *app = &generator; /* layer 5 */
+
+/* replace the generator by another application */
+void app_register(struct application *application)
+{
+	app = application;
+}
+
+/* the entities of the current flow have run: call back the application */
+/* of those refused that have credit again                               */
+void app_wake(void)
+{
+	struct stream *s;
+	int e;
+
+	for (e = A; e <= B; e++)
+	{
+		s = stream_of(curflow, e);
+		if (s->refused && app_credits(e) > 0)
+		{
+			s->refused = 0;
+			if (app->writable != NULL)
+				app->writable(e);
+		}
+	}
+}
+
+/*************************** RECEIVE BUFFERS **************************/
+/* With -W <msgs>,<rate>, a msg given to tolayer5() is not read by the  */
+/* application at once: it waits in the receive buffer of the entity,  */
+/* which holds that many msgs, and the application reads them in order */
+/* at rate msgs per time unit, one APP_READ event at a time.  The      */
+/* protocol learns the room left with getrwnd(), to advertise it to    */
+/* the peer; a msg delivered to a full buffer is dropped and counted   */
+/* as an overflow.  Once the application has read half of a buffer     */
+/* that was full, the protocol is called with windowupdate(), as a     */
+/* receiver avoids advertising a window too small to be worth using.   */
+/**********************************************************************/
+
+/* the receive buffer of one entity of one flow */
+struct rcvbuf
+{
+	int used;	 /* msgs delivered, not yet read */
+	int full;	 /* was full since the last window update */
+	int reading; /* an APP_READ event is scheduled */
+};
+
+int rcvbufsize = 0;		/* -W: msgs a receive buffer holds, 0 for no buffer */
+float readrate;			/* msgs the application reads per time unit */
+struct rcvbuf *rcvbufs; /* of each entity of each flow */
+
+/* -W msgs,rate: 1 if well formed */
+int rcvbuf_parse(char *arg)
+{
+	return sscanf(arg, "%d,%f", &rcvbufsize, &readrate) == 2 && rcvbufsize > 0 && readrate > 0;
+}
+
+/* schedule the next read of the application at AorB of the current flow */
+void rcvbuf_read_after(int AorB)
+{
+	struct event *evptr = (struct event *)malloc(sizeof(struct event));
+
+	evptr->evtime = simtime + 1 / readrate;
+	evptr->evtype = APP_READ;
+	evptr->eventity = AorB;
+	evptr->evflow = curflow;
+	insertevent(evptr);
+	rcvbufs[2 * curflow + AorB].reading = 1;
+}
+
+/* a msg for the application at AorB of the current flow: 0 if the */
+/* buffer is full and drops it                                       */
+int rcvbuf_put(int AorB)
+{
+	struct rcvbuf *b = &rcvbufs[2 * curflow + AorB];
+
+	if (b->used == rcvbufsize)
+	{
+		stats.tally[(AorB + 1) % 2].noverflow++;
+		if (TRACE > 0)
+			printf("          TOLAYER5: receive buffer full at %c, msg dropped\n", AorB == A ? 'A' : 'B');
+		return 0;
+	}
+	if (++b->used == rcvbufsize)
+		b->full = 1;
+	if (!b->reading)
+		rcvbuf_read_after(AorB);
+	return 1;
+}
+
+/* the application at AorB of the current flow reads a msg */
+void rcvbuf_read(int AorB)
+{
+	struct rcvbuf *b = &rcvbufs[2 * curflow + AorB];
+	void (*update)(void) = AorB == A ? protocol->A_windowupdate : protocol->B_windowupdate;
+
+	b->used--;
+	b->reading = 0;
+	if (b->used > 0)
+		rcvbuf_read_after(AorB);
+	if (b->full && rcvbufsize - b->used >= (rcvbufsize + 1) / 2)
+	{
+		b->full = 0;
+		stats.tally[(AorB + 1) % 2].nupdate++;
+		if (update != NULL)
+			update();
+	}
+}
+
+/* print the event about to be simulated */
+void print_event(struct event *eventptr)
+{
+	if (TRACE >= 2)
+	{
+		printf("\nEVENT time: %f,", eventptr->evtime);
+		printf("  type: %d", eventptr->evtype);
+		if (eventptr->evtype == 0)
+			printf(", timerinterrupt  ");
+		else if (eventptr->evtype == 1)
+			printf(", fromlayer5 ");
+		else if (eventptr->evtype == APP_READ)
+			printf(", applicationread ");
+		else
+			printf(", fromlayer3 ");
+		printf(" entity: %d", eventptr->eventity);
+		if (nflows > 1)
+			printf(" flow: %d", eventptr->evflow);
+		printf("\n");
+	}
+}
+
+/* simulate an event taken from the event list, at its time */
+void simulate(struct event *eventptr)
+{
+	struct pkt pkt2give;
+	int i, k, type = eventptr->evtype, entity = eventptr->eventity;
+	long long start = profiling ? prof_ticks() : 0;
+
+	stats.nsimulated++;
+	curflow = eventptr->evflow;
+	if (eventptr->evtype == FROM_LAYER5)
+	{
+		generate_next_arrival(); /* set up future arrival */
+		for (k = 0; k < eventptr->evcount && nsim < msgs_max(); k++)
+		{
+			nsim++;
+			app->arrival(eventptr->eventity);
+		}
+		if (arrival == ARRIVAL_SATURATE)
+		{
+			sources[curflow].pending = 0; /* given: top up again when needed */
+			arrival_topup(A);
+		}
+	}
+	else if (eventptr->evtype == FROM_LAYER3)
+	{
+		pkt2give.flow = eventptr->pktptr->flow;
+		pkt2give.seqnum = eventptr->pktptr->seqnum;
+		pkt2give.acknum = eventptr->pktptr->acknum;
+		pkt2give.rwnd = eventptr->pktptr->rwnd;
+		pkt2give.checksum = eventptr->pktptr->checksum;
+		for (i = 0; i < 20; i++)
+			pkt2give.payload[i] = eventptr->pktptr->payload[i];
+		if (eventptr->eventity == A) /* deliver packet by calling */
+			protocol->A_input(pkt2give);		 /* appropriate entity */
+		else
+			protocol->B_input(pkt2give);
+		free(eventptr->pktptr); /* free the memory for packet */
+	}
+	else if (eventptr->evtype == APP_READ)
+		rcvbuf_read(eventptr->eventity);
+	else if (eventptr->evtype == TIMER_INTERRUPT)
+	{
+		timers[2 * curflow + eventptr->eventity] = NULL;
+		stats.ntimerfired[eventptr->eventity]++;
+		if (eventptr->eventity == A)
+			protocol->A_timerinterrupt();
+		else
+			protocol->B_timerinterrupt();
+	}
+	else
+	{
+		printf("INTERNAL PANIC: unknown event type \n");
+	}
+	app_wake();
+	free(eventptr);
+	if (profiling)
+	{
+		stats.profile.count[type][entity]++;
+		stats.profile.ticks[type][entity] += prof_ticks() - start;
+	}
+}
+
+/*************************** CHANNEL IMPAIRMENTS **********************/
+/* Each direction of the channel, named by the entity sending, loses   */
+/* and corrupts packets as set up by these options; an argument        */
+/* starting with "A:" or "B:" applies to that sender only.             */
+/*   -l prob     loss probability (default: the one asked for)         */
+/*   -c prob     corruption probability (default: the one asked for)   */
+/*   -G p,r[,bad[,good]]   Gilbert-Elliott burst loss instead of -l:   */
+/*               the channel goes bad with probability p and good      */
+/*               again with probability r at each packet, and loses    */
+/*               it with probability bad (1) or good (0) in that state */
+/*   -R prob,spread  reordering: a packet is held back with            */
+/*               probability prob, arriving up to spread time units    */
+/*               later than it would, after packets sent behind it.    */
+/*               Only the others' arrival times constrain it, so this  */
+/*               costs nothing more than the in-order schedule.        */
+/*   -D prob     duplication: the channel carries a second copy of the */
+/*               packet with probability prob, lost, delayed and       */
+/*               corrupted independently of the first                  */
+/*   -E ber      bit errors instead of -c: every bit of the seqnum,    */
+/*               acknum, checksum and payload flips with probability   */
+/*               ber.  The bits are picked by a pattern drawn once per */
+/*               packet and then jumping from flip to flip             */
+/*               (geometric gaps), so clean bits cost nothing; the     */
+/*               pattern is what the event trace records.              */
+/**********************************************************************/
+
+/* bits that -E may flip: the packet from seqnum on */
+#define PKT_BITS (8 * (int)(sizeof(struct pkt) - offsetof(struct pkt, seqnum)))
+
+struct impairment
+{
+	float lossprob;	   /* Bernoulli loss, if not gilbert */
+	float corruptprob; /* corruption as in the original, if not ber */
+	int gilbert;	   /* Gilbert-Elliott loss */
+	float p, r;		   /* probabilities of going bad, and good again */
+	float lossbad, lossgood;
+	double ber;
+	float reorderprob, spread;
+	float dupprob;
+};
+struct impairment impair[2] = {{-1, -1}, {-1, -1}}; /* of packets sent by each entity */
+_Thread_local int channel_bad[2];					/* -G: the Gilbert-Elliott state of each */
+
+/* apply option opt with argument arg to the directions it names; */
+/* returns 0 if the argument is not valid                          */
+int impair_parse(int opt, char *arg)
+{
+	int from = A, to = B, d;
+	struct impairment m;
+
+	if ((arg[0] == 'A' || arg[0] == 'B') && arg[1] == ':')
+	{
+		from = to = arg[0] == 'A' ? A : B;
+		arg += 2;
+	}
+	for (d = from; d <= to; d++)
+	{
+		m = impair[d];
+		if (opt == 'l' && sscanf(arg, "%f", &m.lossprob) != 1)
+			return 0;
+		if (opt == 'c' && sscanf(arg, "%f", &m.corruptprob) != 1)
+			return 0;
+		if (opt == 'G')
+		{
+			m.gilbert = 1;
+			m.lossbad = 1;
+			m.lossgood = 0;
+			if (sscanf(arg, "%f,%f,%f,%f", &m.p, &m.r, &m.lossbad, &m.lossgood) < 2)
+				return 0;
+		}
+		if (opt == 'E' && (sscanf(arg, "%lf", &m.ber) != 1 || m.ber < 0 || m.ber > 1))
+			return 0;
+		if (opt == 'R' && (sscanf(arg, "%f,%f", &m.reorderprob, &m.spread) != 2 || m.spread < 0))
+			return 0;
+		if (opt == 'D' && sscanf(arg, "%f", &m.dupprob) != 1)
+			return 0;
+		impair[d] = m;
+	}
+	return 1;
+}
+
+/* bits of a -E pattern to skip before the next one to flip */
+long long ber_gap(double ber, unsigned int *pattern)
+{
+	return (long long)(log(uniform_open(pattern)) / log1p(-ber));
+}
+
+/* 1 if the -E pattern flips any bit of a packet */
+int ber_corrupts(double ber, unsigned int pattern)
+{
+	return ber_gap(ber, &pattern) < PKT_BITS;
+}
+
+/* flip the bits of packet that the -E pattern picks */
+void ber_flip(struct pkt *packet, double ber, unsigned int pattern)
+{
+	unsigned char *bits = (unsigned char *)&packet->seqnum;
+	long long bit;
+
+	if (ber <= 0) /* replaying a trace recorded with -E without it */
+		return;
+	for (bit = ber_gap(ber, &pattern); bit < PKT_BITS; bit += 1 + ber_gap(ber, &pattern))
+	{
+		bits[bit / 8] ^= 1 << (bit % 8);
+		stats.nflipped++;
+	}
+}
+
+/*************************** PARALLEL SIMULATION **********************/
+/* With -p <threads>, the flows are split among that many partitions,  */
+/* flow f going to partition f % threads, each simulated by a thread   */
+/* of its own with an event list of its own.  Flows only meet in the   */
+/* channel, and a packet given to the channel arrives LOOKAHEAD time   */
+/* units later at the earliest.  So the simulation advances in windows */
+/* [T, T+LOOKAHEAD) from the earliest pending event T (YAWNS): all     */
+/* partitions simulate the events of the window in parallel, keeping   */
+/* the packets their entities give to layer 3 in an outbox; then the   */
+/* channel takes all of them in (time, flow) order and posts each      */
+/* arrival, which falls in a later window, to the inbox of the         */
+/* partition of its flow.  A barrier separates the two phases, so the  */
+/* outboxes and inboxes are handed over without any lock.              */
+/* Each flow draws its arrivals, and each direction of the channel its */
+/* decisions, from a random number stream of its own, and the end of   */
+/* the run, the nsimmax-th arrival, is found beforehand by generating  */
+/* the arrival times alone.  The results are thus the same for any     */
+/* number of threads; only the lines printed while simulating          */
+/* interleave differently.  Several flows without -p are simulated the */
+/* same way, window by window on one event list, so that they match    */
+/* -p too; a single flow keeps the original trajectory, with rand().   */
+/**********************************************************************/
+
+#define LOOKAHEAD 1.0 /* least time a packet spends in the channel */
+
+/* a packet given to layer 3, for the channel to take */
+struct send
+{
+	float time;		 /* when it was given */
+	int entity;		 /* by which entity */
+	int flow;		 /* of which flow */
+	int order;		 /* its place in the outbox */
+	struct pkt packet;
+};
+
+struct partition
+{
+	pthread_t thread;
+	struct send *outbox; /* packets given to layer 3 in the current window */
+	int noutbox, outboxsize;
+	struct event **inbox; /* arrivals posted by the channel */
+	int ninbox, inboxsize;
+	float next;			 /* time of its earliest event */
+	int nsim;			 /* msgs its flows got from layer 5 */
+	struct stats *stats; /* its statistics, once finished */
+};
+
+int nthreads = 0;					 /* -p: simulate the flows on this many threads */
+int windowed = 0;					 /* the simulated channel takes packets window by window */
+struct partition *partitions;		 /* one per thread */
+_Thread_local struct partition *part; /* simulated by this thread */
+pthread_barrier_t window_barrier;
+float window_end;			  /* events before this time are in the current window */
+int finished;				  /* no window left to simulate */
+float stop_time;			  /* time of the nsimmax-th arrival */
+int stop_flow;				  /* and its flow */
+struct send *sends;			  /* all outboxes, in the order the channel takes them */
+int sendssize;
+unsigned int *arrivalseeds;	  /* random number stream of the arrivals of each flow */
+_Thread_local unsigned int channelseeds[2]; /* and of the channel towards each entity */
+
+/* the current entity gives packet to layer 3 */
+void outbox_post(int AorB, struct pkt *packet)
+{
+	struct send *s;
+
+	if (part->noutbox == part->outboxsize)
+	{
+		part->outboxsize = part->outboxsize ? 2 * part->outboxsize : 256;
+		part->outbox = (struct send *)realloc(part->outbox, part->outboxsize * sizeof(struct send));
+	}
+	s = &part->outbox[part->noutbox];
+	s->time = simtime;
+	s->entity = AorB;
+	s->flow = curflow;
+	s->order = part->noutbox++;
+	s->packet = *packet;
+}
+
+/* the channel schedules the arrival e in the partition of its flow */
+void inbox_post(struct event *e)
+{
+	struct partition *p = &partitions[e->evflow % nthreads];
+
+	if (p->ninbox == p->inboxsize)
+	{
+		p->inboxsize = p->inboxsize ? 2 * p->inboxsize : 256;
+		p->inbox = (struct event **)realloc(p->inbox, p->inboxsize * sizeof(struct event *));
+	}
+	p->inbox[p->ninbox++] = e;
+	if (e->evtime < p->next)
+		p->next = e->evtime;
+}
+
+int sendcompare(const void *a, const void *b)
+{
+	const struct send *p = a, *q = b;
+
+	if (p->time != q->time)
+		return p->time < q->time ? -1 : 1;
+	if (p->flow != q->flow)
+		return p->flow - q->flow;
+	return p->order - q->order; /* same flow, so same outbox */
+}
+
+/* the channel takes the packets given to layer 3 in the window just */
+/* simulated, in the same order whatever the number of partitions    */
+void channel_run(void)
+{
+	int nparts = nthreads > 0 ? nthreads : 1; /* 1 without -p */
+	int i, n = 0;
+
+	for (i = 0; i < nparts; i++)
+		n += partitions[i].noutbox;
+	if (n > sendssize)
+	{
+		sendssize = n;
+		sends = (struct send *)realloc(sends, sendssize * sizeof(struct send));
+	}
+	for (n = 0, i = 0; i < nparts; i++)
+	{
+		memcpy(&sends[n], partitions[i].outbox, partitions[i].noutbox * sizeof(struct send));
+		n += partitions[i].noutbox;
+		partitions[i].noutbox = 0;
+	}
+	qsort(sends, n, sizeof(struct send), sendcompare);
+	for (i = 0; i < n; i++)
+	{
+		simtime = sends[i].time;
+		curflow = sends[i].flow;
+		channel_send(sends[i].entity, &sends[i].packet);
+	}
+}
+
+/* 1 if e is still to be simulated in the current window */
+int in_window(struct event *e)
+{
+	if (e->evtime >= window_end)
+		return 0;
+	if (e->evtime < stop_time)
+		return 1;
+	return e->evtime == stop_time && e->evtype == FROM_LAYER5 && e->evflow <= stop_flow;
+}
+
+/* between windows, on one thread: the channel takes the packets sent */
+/* in the last window, then the next window starts at the earliest    */
+/* event of all partitions                                            */
+void window_next(void)
+{
+	float next = FLT_MAX;
+	int i;
+
+	channel_run();
+	for (i = 0; i < nthreads; i++)
+		if (partitions[i].next < next)
+			next = partitions[i].next;
+	if (window_end > stop_time || next == FLT_MAX)
+	{
+		finished = 1;
+		simtime = next; /* the simulation stops at the first event not simulated */
+		return;
+	}
+	window_end = next + LOOKAHEAD;
+}
+
+/* simulate the flows of partition p, in step with the other partitions */
+void *partition_run(void *arg)
+{
+	struct partition *p = (struct partition *)arg;
+	struct event *eventptr;
+	int i;
+
+	part = p;
+	/* the protocol may keep state for all flows, so its entities */
+	/* are initialized one partition at a time                     */
+	for (i = 0; i < nthreads; i++)
+	{
+		if (p == &partitions[i])
+			for (curflow = i; curflow < nflows; curflow += nthreads)
+			{
+				generate_next_arrival();
+				protocol->A_init();
+				protocol->B_init();
+			}
+		pthread_barrier_wait(&window_barrier);
+	}
+
+	while (1)
+	{
+		for (i = 0; i < p->ninbox; i++)
+			insertevent(p->inbox[i]);
+		p->ninbox = 0;
+		while (nevents > 0 && in_window(evlist[0]))
+		{
+			eventptr = nextevent();
+			print_event(eventptr);
+			simtime = eventptr->evtime;
+			simulate(eventptr);
+		}
+		p->next = nevents > 0 ? evlist[0]->evtime : FLT_MAX;
+
+		pthread_barrier_wait(&window_barrier);
+		if (p == partitions)
+			window_next();
+		pthread_barrier_wait(&window_barrier);
+		if (finished)
+			break;
+	}
+
+	if (p != partitions) /* partition 0 is simulated by the main thread */
+	{
+		p->nsim = nsim;
+		p->stats = (struct stats *)malloc(sizeof(struct stats));
+		*p->stats = stats;
+	}
+	return NULL;
+}
+
+/* 1 if the next arrival of flow f comes before that of flow g */
+int arrives_first(float *next, int f, int g)
+{
+	return next[f] < next[g] || (next[f] == next[g] && f < g);
+}
+
+/* move the flow at i of heap down until the flows below arrive later */
+void flow_siftdown(int *heap, float *next, int i)
+{
+	int j, f = heap[i];
+
+	while ((j = 2 * i + 1) < nflows)
+	{
+		if (j + 1 < nflows && arrives_first(next, heap[j + 1], heap[j]))
+			j++;
+		if (!arrives_first(next, heap[j], f))
+			break;
+		heap[i] = heap[j];
+		i = j;
+	}
+	heap[i] = f;
+}
+
+/* time and flow of the nsimmax-th msg from layer 5, taking the arrivals */
+/* of all flows in (time, flow) order from copies of their streams       */
+void find_stop(void)
+{
+	unsigned int *seeds = (unsigned int *)malloc(nflows * sizeof(unsigned int));
+	struct source *srcs = (struct source *)malloc(nflows * sizeof(struct source));
+	float *next = (float *)malloc(nflows * sizeof(float));
+	int *heap = (int *)malloc(nflows * sizeof(int)); /* flows, earliest arrival first */
+	int i, f, entity;
+
+	memcpy(seeds, arrivalseeds, nflows * sizeof(unsigned int));
+	memcpy(srcs, sources, nflows * sizeof(struct source));
+	for (f = 0; f < nflows; f++)
+	{
+		next[f] = arrival_after(0.0, &srcs[f], &seeds[f], &entity);
+		heap[f] = f;
+	}
+	for (i = nflows / 2 - 1; i >= 0; i--)
+		flow_siftdown(heap, next, i);
+
+	stop_time = -FLT_MAX;
+	stop_flow = -1;
+	for (i = 0; i < nsimmax; i++)
+	{
+		f = heap[0];
+		stop_time = next[f];
+		stop_flow = f;
+		next[f] = arrival_after(next[f], &srcs[f], &seeds[f], &entity);
+		flow_siftdown(heap, next, 0);
+	}
+	free(seeds);
+	free(srcs);
+	free(next);
+	free(heap);
+}
+
+/* seed the random number streams of the arrivals and of the channel */
+void streams_seed(void)
+{
+	int i;
+
+	arrivalseeds = (unsigned int *)malloc(nflows * sizeof(unsigned int));
+	for (i = 0; i < nflows; i++)
+		arrivalseeds[i] = 9999 + i;
+	channelseeds[A] = 9997;
+	channelseeds[B] = 9998;
+}
+
+/* simulate on nthreads threads, this one taking partition 0 */
+void parallel_run(void)
+{
+	int i;
+
+	find_stop();
+
+	partitions = (struct partition *)calloc(nthreads, sizeof(struct partition));
+	window_end = -FLT_MAX;
+	pthread_barrier_init(&window_barrier, NULL, nthreads);
+	for (i = 1; i < nthreads; i++)
+		pthread_create(&partitions[i].thread, NULL, partition_run, &partitions[i]);
+	partition_run(&partitions[0]);
+	for (i = 1; i < nthreads; i++)
+	{
+		pthread_join(partitions[i].thread, NULL);
+		nsim += partitions[i].nsim;
+		stats_merge(partitions[i].stats);
+	}
+	pthread_barrier_destroy(&window_barrier);
+}
+
+/****************************** UDP BACKEND ***************************/
+/* With -b udp, the entities exchange their packets over a pair of UDP */
+/* sockets connected to each other on 127.0.0.1 instead of through the */
+/* simulated channel, and time is the monotonic clock, one time unit   */
+/* lasting -w microseconds (1 by default).  The rest is as simulated:  */
+/* msgs come from layer 5 at the times the arrival process draws, and  */
+/* the channel model still decides the loss, delay, corruption,        */
+/* reordering and duplication of each packet.  This shim holds the     */
+/* packet until the arrival time the model gives it and only then      */
+/* sends it, so loopback adds its own latency on top; no netem needed. */
+/* All flows share the socket pair, told apart by the flow field, and  */
+/* each datagram carries the time it was sent, for the wire latency.   */
+/* Timers, msg arrivals and held packets wait in a timer wheel of      */
+/* WHEEL_SLOTS slots of one time unit, events further ahead going      */
+/* round it; a timerfd wakes the epoll loop at the earliest.  A bitmap */
+/* of the slots holding events lets the wheel skip empty slots 64 at   */
+/* a time, and each slot keeps the times of its events in an array of  */
+/* their own, so finding the due ones is a sweep over floats.  Packets */
+/* are read UDP_BATCH at a time with recvmmsg(), and written with      */
+/* sendmmsg(), or UDP_BATCH to a send with UDP GSO where the kernel    */
+/* supports it.  The run ends, as simulated, once the last msg has     */
+/* been given.                                                         */
+/* With -b uring, the same is done through io_uring instead of epoll   */
+/* (see IO_URING below), falling back to epoll if the kernel cannot.   */
+/* With -p, the flows are sharded among threads (see SHARDED ENGINE).  */
+/**********************************************************************/
+
+#define WHEEL_SLOTS 4096 /* a power of 2 */
+#define UDP_BATCH 64	 /* datagrams per system call; GSO takes up to 64 */
+
+struct wheelslot
+{
+	struct event **ev; /* in no order; an event knows its place */
+	float *time;	   /* evtime of each of ev */
+	int n, size;
+};
+
+/* a datagram */
+struct wire
+{
+	unsigned int shard; /* owning the flow, in network byte order, first for the steering program */
+	float sent;			/* time the sender sent it */
+	struct pkt packet;
+};
+
+/* what the backend asked of the kernel */
+struct udpstats
+{
+	long long nsendmmsg, nrecvmmsg, nwait, nenter; /* system calls */
+	long long nsent, nreceived, ndropped;		   /* datagrams; dropped when a socket buffer or queue is full */
+	long long nhandoff;							   /* datagrams passed on to the shard owning their flow */
+	struct histogram wire;						   /* latency from send to delivery */
+};
+
+char *backend_names[] = {"sim", "udp", "uring", NULL};
+double time_unit = 1.0; /* -w: microseconds per time unit */
+struct sockaddr_in udpaddr[2]; /* of the sockets of each entity */
+int (*udpsocks)[2];			   /* sockets of each entity, for each shard */
+int gsoable;				   /* 1 if the sockets take a GSO segment size */
+struct timespec udpstart;	   /* time 0 */
+/* the state of the flows run by a thread */
+_Thread_local struct wheelslot wheel[WHEEL_SLOTS];
+_Thread_local unsigned long long wheel_used[WHEEL_SLOTS / 64]; /* bit of each slot holding events */
+_Thread_local long long wheel_tick; /* slots before this one have been emptied */
+_Thread_local int udpsock[2];		/* socket of each entity */
+_Thread_local struct wire *udpout[2]; /* datagrams each entity has to send */
+_Thread_local int nudpout[2], udpoutsize[2];
+_Thread_local int udpgso; /* 1 while GSO sends work */
+_Thread_local struct udpstats udpstats;
+_Thread_local int shardno;	   /* -p: the shard run by this thread */
+_Thread_local int wakefd = -1; /* and its eventfd */
+int steered;				   /* 1 if the BPF program steers datagrams */
+
+int flow_shard(int f);
+int shard_finish(void);
+void shard_handoff(int AorB, struct wire *w);
+void shard_wake(void);
+void shard_drain(void);
+
+/* -b name: 1 if name is a backend */
+int backend_parse(char *name)
+{
+	int i;
+
+	for (i = 0; backend_names[i] != NULL; i++)
+		if (strcmp(name, backend_names[i]) == 0)
+		{
+			backend = i;
+			return 1;
+		}
+	return 0;
+}
+
+void wheel_insert(struct event *p)
+{
+	long long tick = (long long)floor(p->evtime);
+	struct wheelslot *s;
+
+	if (tick < wheel_tick) /* already due */
+		tick = wheel_tick;
+	p->wheelslot = tick & (WHEEL_SLOTS - 1);
+	s = &wheel[p->wheelslot];
+	if (s->n == s->size)
+	{
+		s->size = s->size ? 2 * s->size : 16;
+		s->ev = (struct event **)realloc(s->ev, s->size * sizeof(struct event *));
+		s->time = (float *)realloc(s->time, s->size * sizeof(float));
+	}
+	if (s->n == 0)
+		wheel_used[p->wheelslot / 64] |= 1ULL << (p->wheelslot % 64);
+	p->heapindex = s->n;
+	s->time[s->n] = p->evtime;
+	s->ev[s->n++] = p;
+	nevents++;
+}
+
+void wheel_remove(struct event *p)
+{
+	struct wheelslot *s = &wheel[p->wheelslot];
+
+	s->n--;
+	s->ev[p->heapindex] = s->ev[s->n];
+	s->time[p->heapindex] = s->time[s->n];
+	s->ev[p->heapindex]->heapindex = p->heapindex;
+	if (s->n == 0)
+		wheel_used[p->wheelslot / 64] &= ~(1ULL << (p->wheelslot % 64));
+	nevents--;
+}
+
+/* first tick of [from, to) whose slot holds events, or to if none; */
+/* to - from is at most WHEEL_SLOTS                                 */
+long long wheel_skip(long long from, long long to)
+{
+	unsigned long long used;
+	long long tick = from;
+	int slot;
+
+	while (tick < to)
+	{
+		slot = tick & (WHEEL_SLOTS - 1);
+		used = wheel_used[slot / 64] >> (slot % 64); /* this slot and the next of its word */
+		if (used != 0)
+		{
+			tick += __builtin_ctzll(used);
+			return tick < to ? tick : to;
+		}
+		tick += 64 - slot % 64;
+	}
+	return to;
+}
+
+/* the earliest event of slot s due by limit, NULL if none is; with */
+/* before, due at limit exactly does not count                      */
+struct event *wheel_earliest(struct wheelslot *s, float limit, int before)
+{
+	struct event *p = NULL;
+	float due = FLT_MAX;
+	int i;
+
+	for (i = 0; i < s->n; i++)
+		if ((s->time[i] < limit || (!before && s->time[i] == limit)) && s->time[i] < due)
+			due = s->time[i];
+	if (profiling)
+		stats.profile.nwheelsteps += s->n + 1;
+	if (due == FLT_MAX)
+		return NULL;
+	for (i = 0; i < s->n; i++) /* the order among events due at the same time */
+		if (s->time[i] == due && (p == NULL || eventbefore(s->ev[i], p)))
+			p = s->ev[i];
+	return p;
+}
+
+/* take out the earliest event due by now, NULL if none is */
+struct event *wheel_next(float now)
+{
+	long long last = (long long)floor(now);
+	struct event *p;
+
+	if (nevents == 0)
+	{
+		if (wheel_tick < last)
+			wheel_tick = last;
+		return NULL;
+	}
+	if (last < wheel_tick)
+		last = wheel_tick;
+	for (;; wheel_tick++)
+	{
+		wheel_tick = wheel_skip(wheel_tick, last < wheel_tick + WHEEL_SLOTS ? last + 1 : wheel_tick + WHEEL_SLOTS);
+		if (wheel_tick > last)
+		{
+			wheel_tick = last;
+			return NULL;
+		}
+		p = wheel_earliest(&wheel[wheel_tick & (WHEEL_SLOTS - 1)], now, 0);
+		if (p != NULL)
+		{
+			wheel_remove(p);
+			return p;
+		}
+		if (wheel_tick >= last)
+			return NULL;
+	}
+}
+
+/* time of the earliest event in the wheel, or one turn ahead if none */
+/* is due before                                                      */
+float wheel_due(void)
+{
+	long long tick, end = wheel_tick + WHEEL_SLOTS;
+	struct event *p;
+
+	for (tick = wheel_skip(wheel_tick, end); tick < end; tick = wheel_skip(tick + 1, end))
+	{
+		p = wheel_earliest(&wheel[tick & (WHEEL_SLOTS - 1)], tick + 1, 1);
+		if (p != NULL)
+			return p->evtime;
+	}
+	return end;
+}
+
+/* time units since time 0 */
+float udp_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (float)(((now.tv_sec - udpstart.tv_sec) * 1e6 + (now.tv_nsec - udpstart.tv_nsec) / 1e3) / time_unit);
+}
+
+/* have timer fd expire at time due */
+void udp_arm(int fd, float due)
+{
+	struct itimerspec when;
+	double ns = udpstart.tv_nsec + (double)due * time_unit * 1e3;
+
+	memset(&when, 0, sizeof(when));
+	when.it_value.tv_sec = udpstart.tv_sec + (time_t)(ns / 1e9);
+	when.it_value.tv_nsec = (long)fmod(ns, 1e9);
+	timerfd_settime(fd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+/* bind n sockets for each entity on loopback, one for each shard, in an */
+/* SO_REUSEPORT group that steers a datagram to the shard it names       */
+void udp_open(int n)
+{
+	struct sock_filter code[] = {
+		{BPF_LD | BPF_W | BPF_ABS, 0, 0, 0}, /* the shard named, host order */
+		{BPF_RET | BPF_A, 0, 0, 0},			 /* is the index of its socket */
+	};
+	struct sock_fprog steer = {sizeof(code) / sizeof(code[0]), code};
+	socklen_t len = sizeof(struct sockaddr_in);
+	int bufsize = 1 << 22, segment = sizeof(struct wire), one = 1, fd, e, s;
+
+	prctl(PR_SET_TIMERSLACK, 1UL); /* wake up on time, not up to 50us late */
+	udpsocks = (int(*)[2])malloc(n * sizeof(*udpsocks));
+	gsoable = 1;
+	steered = n > 1;
+	for (e = A; e <= B; e++)
+	{
+		memset(&udpaddr[e], 0, sizeof(udpaddr[e]));
+		udpaddr[e].sin_family = AF_INET;
+		udpaddr[e].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		for (s = 0; s < n; s++) /* the first bind picks the port of the others */
+		{
+			fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+			if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+				bind(fd, (struct sockaddr *)&udpaddr[e], len) < 0 ||
+				getsockname(fd, (struct sockaddr *)&udpaddr[e], &len) < 0)
+			{
+				perror("udp");
+				exit(1);
+			}
+			setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+			/* with a segment size set on the socket, any longer send */
+			/* is cut into datagrams of that size by the kernel       */
+#ifdef UDP_SEGMENT
+			if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) < 0)
+#endif
+				gsoable = 0;
+			udpsocks[s][e] = fd;
+		}
+		if (n > 1 && setsockopt(udpsocks[0][e], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &steer, sizeof(steer)) < 0)
+			steered = 0; /* the kernel spreads them by address instead */
+	}
+	(void)segment;
+}
+
+/* the shim lets go of a held packet: its sender sends it */
+void udp_post(struct event *e)
+{
+	int from = 1 - e->eventity;
+
+	if (nudpout[from] == udpoutsize[from])
+	{
+		udpoutsize[from] = udpoutsize[from] ? 2 * udpoutsize[from] : 256;
+		udpout[from] = (struct wire *)realloc(udpout[from], udpoutsize[from] * sizeof(struct wire));
+	}
+	udpout[from][nudpout[from]].shard = htonl(shardno);
+	udpout[from][nudpout[from]++].packet = *e->pktptr;
+	free(e->pktptr);
+	free(e);
+}
+
+/* take the events due by now, the shim handing the packets it lets go */
+/* to their senders; returns 0 once the run is over, for all shards     */
+int udp_due(void)
+{
+	struct event *e;
+
+	simtime = udp_now();
+	while (nsim < msgs_max() && (e = wheel_next(simtime)) != NULL)
+		if (e->evtype == TO_WIRE)
+			udp_post(e);
+		else
+		{
+			print_event(e);
+			simulate(e);
+		}
+	if (nsim < msgs_max() && (nevents > 0 || ninflight[A] + ninflight[B] > 0))
+		return 1;
+	return nthreads > 0 && shard_finish(); /* keep passing datagrams on */
+}
+
+/* time to wait until for more to do: the next event of the wheel, or */
+/* FLT_MAX once the shard only passes datagrams on                     */
+float udp_wait(void)
+{
+	if (nthreads > 0 && nsim >= msgs_max())
+		return FLT_MAX;
+	return wheel_due();
+}
+
+/* deliver a datagram of len bytes that came to entity AorB */
+void udp_deliver(int AorB, struct wire *w, int len)
+{
+	long long start = profiling ? prof_ticks() : 0;
+
+	if (len != sizeof(struct wire) || w->packet.flow < 0 || w->packet.flow >= nflows)
+		return; /* not from the other entity */
+	if (nthreads > 0 && flow_shard(w->packet.flow) != shardno)
+	{
+		shard_handoff(AorB, w);
+		return;
+	}
+	udpstats.nreceived++;
+	stats.nsimulated++;
+	ninflight[AorB]--;
+	hist_record(&udpstats.wire, simtime - w->sent);
+	curflow = w->packet.flow;
+	if (AorB == A)
+		protocol->A_input(w->packet);
+	else
+		protocol->B_input(w->packet);
+	app_wake();
+	if (profiling)
+	{
+		stats.profile.count[FROM_LAYER3][AorB]++;
+		stats.profile.ticks[FROM_LAYER3][AorB] += prof_ticks() - start;
+	}
+}
+
+/* send the datagrams entity AorB has to send, UDP_BATCH at a time */
+void udp_flush(int AorB)
+{
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	int done = 0, batch, nmsgs, sent, i;
+	float now = udp_now();
+
+	for (i = 0; i < nudpout[AorB]; i++)
+		udpout[AorB][i].sent = now;
+	while (done < nudpout[AorB])
+	{
+		batch = nudpout[AorB] - done < UDP_BATCH ? nudpout[AorB] - done : UDP_BATCH;
+		memset(msgs, 0, sizeof(msgs));
+		if (udpgso) /* one send the kernel cuts into batch datagrams */
+		{
+			iov[0].iov_base = &udpout[AorB][done];
+			iov[0].iov_len = batch * sizeof(struct wire);
+			msgs[0].msg_hdr.msg_name = &udpaddr[1 - AorB];
+			msgs[0].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[0].msg_hdr.msg_iov = iov;
+			msgs[0].msg_hdr.msg_iovlen = 1;
+			nmsgs = 1;
+		}
+		else
+		{
+			for (i = 0; i < batch; i++)
+			{
+				iov[i].iov_base = &udpout[AorB][done + i];
+				iov[i].iov_len = sizeof(struct wire);
+				msgs[i].msg_hdr.msg_name = &udpaddr[1 - AorB];
+				msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			nmsgs = batch;
+		}
+		sent = sendmmsg(udpsock[AorB], msgs, nmsgs, 0);
+		udpstats.nsendmmsg++;
+		if (sent < 0 && udpgso && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			udpgso = 0; /* not supported here: send them one by one */
+			continue;
+		}
+		if (sent < 0) /* the socket buffer is full: they are lost */
+		{
+			udpstats.ndropped += batch;
+			ninflight[1 - AorB] -= batch;
+			done += batch;
+			continue;
+		}
+		if (!udpgso)
+			batch = sent;
+		udpstats.nsent += batch;
+		done += batch;
+	}
+	nudpout[AorB] = 0;
+}
+
+/* deliver the datagrams that came to entity AorB */
+void udp_receive(int AorB)
+{
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct wire in[UDP_BATCH];
+	int n, i;
+
+	do
+	{
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < UDP_BATCH; i++)
+		{
+			iov[i].iov_base = &in[i];
+			iov[i].iov_len = sizeof(struct wire);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		n = recvmmsg(udpsock[AorB], msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+		udpstats.nrecvmmsg++;
+		simtime = udp_now();
+		for (i = 0; i < n; i++)
+			udp_deliver(AorB, &in[i], msgs[i].msg_len);
+	} while (n == UDP_BATCH);
+	shard_wake();
+}
+
+/* run in real time, waiting with epoll */
+void epoll_run(void)
+{
+	struct epoll_event ev, ready[4];
+	unsigned long long expired;
+	int epfd, tfd, fds[4], nfds = 3, timeout, more, n, i;
+	float due;
+
+	epfd = epoll_create1(0);
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	fds[A] = udpsock[A];
+	fds[B] = udpsock[B];
+	fds[2] = tfd;
+	if (wakefd >= 0)
+		fds[nfds++] = wakefd;
+	for (i = 0; i < nfds; i++)
+	{
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) < 0)
+		{
+			perror("epoll");
+			exit(1);
+		}
+	}
+
+	while (1)
+	{
+		more = udp_due();
+		udp_flush(A);
+		udp_flush(B);
+		if (!more)
+			break;
+
+		due = udp_wait();
+		timeout = 0;
+		if (due == FLT_MAX)
+			timeout = -1; /* only passing datagrams on */
+		else if (due > udp_now())
+		{
+			udp_arm(tfd, due);
+			timeout = -1;
+		}
+		n = epoll_wait(epfd, ready, nfds, timeout);
+		udpstats.nwait++;
+		for (i = 0; i < n; i++)
+			if (ready[i].data.u32 == 3)
+				shard_drain();
+			else if (ready[i].data.u32 == 2)
+				(void)!read(tfd, &expired, sizeof(expired));
+			else
+				udp_receive(ready[i].data.u32);
+	}
+	close(tfd);
+	close(epfd);
+}
+
+/******************************* IO_URING *****************************/
+/* With -b uring, one io_uring, driven by raw system calls, carries    */
+/* all the I/O.  Each socket has a multishot receive armed, which      */
+/* picks its buffers from a ring of URING_BUFS datagram buffers        */
+/* registered for the entity, so receiving costs no system call of its */
+/* own: the datagrams come as completions, delivered in the batch the  */
+/* kernel hands back.  Sends go out UDP_BATCH datagrams to a GSO       */
+/* sendmsg (one per datagram without GSO) from one of URING_SLOTS      */
+/* staging slots, kept until the send completes.  Submitting and       */
+/* waiting for the next completion, up to the next event of the wheel, */
+/* take a single io_uring_enter().  The ring belongs to the thread, so */
+/* each shard has one.                                                 */
+/**********************************************************************/
+
+#define URING_ENTRIES 256 /* submission queue size */
+#define URING_BUFS 512	  /* receive buffers of each entity, a power of 2 */
+#define URING_SLOTS 64	  /* send staging slots */
+#define URING_RECV 1000	  /* user_data of the receive of entity AorB: URING_RECV + AorB */
+#define URING_WAKE 2000	  /* user_data of the read of the shard's eventfd */
+
+/* datagrams being sent */
+struct sendslot
+{
+	struct wire packets[UDP_BATCH];
+	struct msghdr msgs[UDP_BATCH]; /* one for all of them with GSO */
+	struct iovec iov[UDP_BATCH];
+	int count;	 /* datagrams */
+	int pending; /* sends not yet completed */
+	int entity;
+};
+
+struct uring
+{
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, sq_entries;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	unsigned sqtail; /* our tail, published when entering */
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *bufring[2]; /* buffers for the receives of each entity */
+	struct wire *bufs[2];
+	unsigned short buftail[2];
+	int multishot;				/* 0 if each receive must be re-armed (before 6.0) */
+	struct sendslot *slots;		/* URING_SLOTS of them */
+	unsigned long long wakeups; /* read from the shard's eventfd */
+};
+_Thread_local struct uring uring;
+
+void uring_enter(float wait);
+
+struct io_uring_sqe *uring_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned index;
+
+	if (uring.sqtail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) == uring.sq_entries)
+		uring_enter(0); /* full: submit what is there */
+	index = uring.sqtail++ & *uring.sq_mask;
+	uring.sq_array[index] = index;
+	sqe = &uring.sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/* give buffer bid back to the ring of entity AorB */
+void uring_recycle(int AorB, int bid)
+{
+	struct io_uring_buf *buf = &uring.bufring[AorB]->bufs[uring.buftail[AorB] & (URING_BUFS - 1)];
+
+	buf->addr = (unsigned long long)&uring.bufs[AorB][bid];
+	buf->len = sizeof(struct wire);
+	buf->bid = bid;
+	uring.buftail[AorB]++;
+	__atomic_store_n(&uring.bufring[AorB]->tail, uring.buftail[AorB], __ATOMIC_RELEASE);
+}
+
+/* (re)arm the receive on the socket of entity AorB */
+void uring_receive(int AorB)
+{
+	struct io_uring_sqe *sqe = uring_sqe();
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = udpsock[AorB];
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = AorB;
+	sqe->ioprio = uring.multishot ? IORING_RECV_MULTISHOT : 0;
+	sqe->user_data = URING_RECV + AorB;
+}
+
+/* (re)arm the read of the eventfd of the shard */
+void uring_wake(void)
+{
+	struct io_uring_sqe *sqe = uring_sqe();
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = wakefd;
+	sqe->addr = (unsigned long long)&uring.wakeups;
+	sqe->len = sizeof(uring.wakeups);
+	sqe->user_data = URING_WAKE;
+}
+
+/* set up the ring, its buffers and the receives; 0 if the kernel cannot */
+int uring_open(void)
+{
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	size_t size;
+	char *sq;
+	int i, AorB;
+
+	memset(&params, 0, sizeof(params));
+	uring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (uring.fd < 0)
+		return 0;
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+	{
+		close(uring.fd);
+		return 0;
+	}
+	size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > size)
+		size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	sq = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+	uring.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || uring.sqes == MAP_FAILED)
+	{
+		close(uring.fd);
+		return 0;
+	}
+	uring.sq_head = (unsigned *)(sq + params.sq_off.head);
+	uring.sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	uring.sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	uring.sq_array = (unsigned *)(sq + params.sq_off.array);
+	uring.sq_entries = params.sq_entries;
+	uring.cq_head = (unsigned *)(sq + params.cq_off.head);
+	uring.cq_tail = (unsigned *)(sq + params.cq_off.tail);
+	uring.cq_mask = (unsigned *)(sq + params.cq_off.ring_mask);
+	uring.cqes = (struct io_uring_cqe *)(sq + params.cq_off.cqes);
+	uring.sqtail = *uring.sq_tail;
+
+	for (AorB = A; AorB <= B; AorB++)
+	{
+		uring.bufring[AorB] = mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+								   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		uring.bufs[AorB] = (struct wire *)malloc(URING_BUFS * sizeof(struct wire));
+		memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = (unsigned long long)uring.bufring[AorB];
+		reg.ring_entries = URING_BUFS;
+		reg.bgid = AorB;
+		if (uring.bufring[AorB] == MAP_FAILED ||
+			syscall(__NR_io_uring_register, uring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		{
+			close(uring.fd); /* before 5.19 */
+			return 0;
+		}
+		for (i = 0; i < URING_BUFS; i++)
+			uring_recycle(AorB, i);
+	}
+	uring.slots = (struct sendslot *)calloc(URING_SLOTS, sizeof(struct sendslot));
+	uring.multishot = 1;
+	uring_receive(A);
+	uring_receive(B);
+	return 1;
+}
+
+/* submit what is queued and take the completions, waiting up to wait */
+/* time units for one if there is none (FLT_MAX: as long as needed)    */
+void uring_enter(float wait)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	double ns = (double)wait * time_unit * 1e3;
+	unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, waitfor = 0;
+
+	memset(&arg, 0, sizeof(arg));
+	if (wait > 0 && *uring.cq_head == __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
+	{
+		waitfor = 1;
+		if (wait < FLT_MAX)
+		{
+			ts.tv_sec = (long long)(ns / 1e9);
+			ts.tv_nsec = (long long)fmod(ns, 1e9);
+			arg.ts = (unsigned long long)&ts;
+		}
+	}
+	__atomic_store_n(uring.sq_tail, uring.sqtail, __ATOMIC_RELEASE);
+	syscall(__NR_io_uring_enter, uring.fd, uring.sqtail - *uring.sq_head, waitfor, flags, &arg, sizeof(arg));
+	udpstats.nenter++;
+}
+
+/* handle the completions: deliver what came, free the sends done */
+void uring_reap(void)
+{
+	struct io_uring_cqe *cqe;
+	struct sendslot *slot;
+	struct wire in;
+	unsigned head = *uring.cq_head;
+	unsigned long long data;
+	int AorB, res, cqeflags;
+
+	simtime = udp_now();
+	while (head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
+	{
+		/* copy all of the completion out before giving its entry back */
+		/* to the kernel, which may fill it in again at once            */
+		cqe = &uring.cqes[head & *uring.cq_mask];
+		res = cqe->res;
+		cqeflags = cqe->flags;
+		data = cqe->user_data;
+		AorB = (int)(data - URING_RECV);
+		slot = data < URING_SLOTS ? &uring.slots[data] : NULL;
+		__atomic_store_n(uring.cq_head, ++head, __ATOMIC_RELEASE);
+
+		if (data == URING_WAKE)
+		{
+			shard_drain();
+			uring_wake();
+			continue;
+		}
+		if (slot != NULL) /* a send */
+		{
+			if (res < 0) /* the socket buffer is full: they are lost */
+			{
+				res = udpgso ? slot->count : 1;
+				udpstats.ndropped += res;
+				ninflight[1 - slot->entity] -= res;
+			}
+			else
+				udpstats.nsent += res / sizeof(struct wire);
+			slot->pending--;
+			continue;
+		}
+		if (cqeflags & IORING_CQE_F_BUFFER)
+		{
+			in = uring.bufs[AorB][cqeflags >> IORING_CQE_BUFFER_SHIFT];
+			uring_recycle(AorB, cqeflags >> IORING_CQE_BUFFER_SHIFT);
+			udp_deliver(AorB, &in, res);
+		}
+		else if (res == -EINVAL && uring.multishot)
+			uring.multishot = 0; /* before 6.0: one receive at a time */
+		if (!(cqeflags & IORING_CQE_F_MORE))
+			uring_receive(AorB);
+	}
+	shard_wake();
+}
+
+/* queue the datagrams entity AorB has to send */
+void uring_flush(int AorB)
+{
+	struct io_uring_sqe *sqe;
+	struct sendslot *slot;
+	int done = 0, batch, i, s;
+	float now = udp_now();
+
+	while (done < nudpout[AorB])
+	{
+		for (s = 0; uring.slots[s].pending > 0; s = (s + 1) % URING_SLOTS)
+			if (s == URING_SLOTS - 1)
+			{
+				uring_enter(FLT_MAX); /* all busy: wait for a send to complete */
+				uring_reap();
+			}
+		slot = &uring.slots[s];
+		batch = nudpout[AorB] - done < UDP_BATCH ? nudpout[AorB] - done : UDP_BATCH;
+		memcpy(slot->packets, &udpout[AorB][done], batch * sizeof(struct wire));
+		slot->entity = AorB;
+		slot->count = batch;
+		for (i = 0; i < batch; i++)
+		{
+			slot->packets[i].sent = now;
+			if (udpgso && i > 0)
+				continue; /* the kernel cuts one send into batch datagrams */
+			slot->iov[i].iov_base = &slot->packets[i];
+			slot->iov[i].iov_len = udpgso ? batch * sizeof(struct wire) : sizeof(struct wire);
+			memset(&slot->msgs[i], 0, sizeof(struct msghdr));
+			slot->msgs[i].msg_name = &udpaddr[1 - AorB];
+			slot->msgs[i].msg_namelen = sizeof(struct sockaddr_in);
+			slot->msgs[i].msg_iov = &slot->iov[i];
+			slot->msgs[i].msg_iovlen = 1;
+			sqe = uring_sqe();
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = udpsock[AorB];
+			sqe->addr = (unsigned long long)&slot->msgs[i];
+			sqe->len = 1;
+			sqe->user_data = s;
+			slot->pending++;
+		}
+		done += batch;
+	}
+	nudpout[AorB] = 0;
+}
+
+/* run in real time, waiting with io_uring */
+void uring_run(void)
+{
+	float due, now;
+	int more;
+
+	while (1)
+	{
+		more = udp_due();
+		uring_flush(A);
+		uring_flush(B);
+		if (!more)
+			break;
+
+		due = udp_wait();
+		now = udp_now();
+		uring_enter(due > now ? due - now : 0);
+		uring_reap();
+	}
+	close(uring.fd);
+}
+
+/*************************** SHARDED ENGINE ***************************/
+/* With -b udp or -b uring and -p <threads>, the flows are sharded     */
+/* among that many threads, flow f going to shard flow_shard(f), a     */
+/* hash of f.  A shard owns its flows outright: their protocol state,  */
+/* timers, arrivals and channel model are only ever touched by its     */
+/* thread, which runs the real-time loop above with a timer wheel,     */
+/* ring and statistics of its own, so the data path takes no lock.     */
+/* The sockets of an entity, one for each shard, form an SO_REUSEPORT  */
+/* group, and a classic BPF program attached to the group hands each   */
+/* datagram to the socket of the shard named in it, the owner of its   */
+/* flow.  Where the program cannot be attached, the kernel spreads the */
+/* datagrams by address instead, and a shard getting one that is not   */
+/* its own passes it on to the owner through a lock-free single-       */
+/* producer single-consumer queue, waking it with an eventfd once per  */
+/* batch.  Each shard gives its share of the msgs from layer 5, in     */
+/* proportion to its flows, then only passes datagrams on until all    */
+/* shards are done.  The protocols are initialized for all             */
+/* flows before the shards start, so per-flow state they allocate on   */
+/* first use is in place.                                              */
+/**********************************************************************/
+
+#define SPSC_SIZE 1024 /* datagrams a handoff queue holds, a power of 2 */
+
+/* a datagram that came to entity of the wrong shard */
+struct handoff
+{
+	int entity;
+	struct wire w;
+};
+
+/* a queue with one producer and one consumer; each index is written */
+/* by one side only, and on a cache line of its own                   */
+struct spsc
+{
+	struct handoff ring[SPSC_SIZE];
+	_Alignas(64) unsigned long head; /* next to take, by the consumer */
+	_Alignas(64) unsigned long tail; /* next to fill, by the producer */
+};
+
+struct shard
+{
+	pthread_t thread;
+	int quota;			 /* msgs its flows get from layer 5 */
+	int wakefd;			 /* eventfd: datagrams were queued for it */
+	struct spsc **inbox; /* from each other shard */
+	int finished;		 /* its msgs are given */
+	int nsim;
+	struct stats *stats; /* its statistics, once finished */
+	struct udpstats *udpstats;
+};
+
+struct shard *shards;		/* one per thread */
+int nrunning;				/* shards whose msgs are not all given */
+_Thread_local char *towake; /* shards this one queued datagrams for */
+
+/* shard owning flow f */
+int flow_shard(int f)
+{
+	return (int)(((unsigned int)f * 2654435761u >> 16) % nthreads);
+}
+
+/* msgs the flows of this thread get from layer 5 */
+int msgs_max(void)
+{
+	return shards != NULL ? shards[shardno].quota : nsimmax;
+}
+
+/* the shard has given its msgs; 1 while others still run, since some */
+/* of their datagrams may come to it to be passed on                   */
+int shard_finish(void)
+{
+	unsigned long long one = 1;
+	int s;
+
+	if (!shards[shardno].finished)
+	{
+		shards[shardno].finished = 1;
+		if (__atomic_sub_fetch(&nrunning, 1, __ATOMIC_SEQ_CST) == 0)
+			for (s = 0; s < nthreads; s++) /* all done: tell the others */
+				(void)!write(shards[s].wakefd, &one, sizeof(one));
+	}
+	return __atomic_load_n(&nrunning, __ATOMIC_SEQ_CST) > 0;
+}
+
+/* pass datagram w, which came to entity AorB, on to the owner of its flow */
+void shard_handoff(int AorB, struct wire *w)
+{
+	int to = flow_shard(w->packet.flow);
+	struct spsc *q = shards[to].inbox[shardno];
+	unsigned long tail = q->tail;
+
+	if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == SPSC_SIZE)
+	{
+		udpstats.ndropped++; /* the owner is behind: lost */
+		return;
+	}
+	q->ring[tail & (SPSC_SIZE - 1)].entity = AorB;
+	q->ring[tail & (SPSC_SIZE - 1)].w = *w;
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	udpstats.nhandoff++;
+	towake[to] = 1;
+}
+
+/* after a batch of datagrams, wake the shards some were passed on to */
+void shard_wake(void)
+{
+	unsigned long long one = 1;
+	int s;
+
+	if (nthreads == 0)
+		return;
+	for (s = 0; s < nthreads; s++)
+		if (towake[s])
+		{
+			towake[s] = 0;
+			(void)!write(shards[s].wakefd, &one, sizeof(one));
+		}
+}
+
+/* deliver the datagrams the other shards passed on to this one */
+void shard_drain(void)
+{
+	unsigned long long wakeups;
+	struct spsc *q;
+	unsigned long head, tail;
+	int s;
+
+	if (backend != BACKEND_URING) /* else the ring has read it */
+		(void)!read(wakefd, &wakeups, sizeof(wakeups));
+	simtime = udp_now();
+	for (s = 0; s < nthreads; s++)
+	{
+		if ((q = shards[shardno].inbox[s]) == NULL)
+			continue;
+		tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		for (head = q->head; head != tail; head++)
+			udp_deliver(q->ring[head & (SPSC_SIZE - 1)].entity, &q->ring[head & (SPSC_SIZE - 1)].w, sizeof(struct wire));
+		__atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
+	}
+}
+
+/* run the flows of shard s in real time */
+void *shard_run(void *arg)
+{
+	struct shard *s = (struct shard *)arg;
+
+	shardno = s - shards;
+	wakefd = s->wakefd;
+	towake = (char *)calloc(nthreads, 1);
+	udpsock[A] = udpsocks[shardno][A];
+	udpsock[B] = udpsocks[shardno][B];
+	udpgso = gsoable;
+	channelseeds[A] = 9997 + 2 * shardno;
+	channelseeds[B] = 9998 + 2 * shardno;
+	if (backend == BACKEND_URING)
+	{
+		if (s != shards && !uring_open()) /* shard 0 has the one of the main thread */
+		{
+			perror("io_uring");
+			exit(1);
+		}
+		uring_wake();
+	}
+	for (curflow = 0; curflow < nflows; curflow++)
+		if (flow_shard(curflow) == shardno)
+			generate_next_arrival();
+	if (backend == BACKEND_URING)
+		uring_run();
+	else
+		epoll_run();
+
+	if (s != shards) /* shard 0 is run by the main thread */
+	{
+		s->nsim = nsim;
+		s->stats = (struct stats *)malloc(sizeof(struct stats));
+		*s->stats = stats;
+		s->udpstats = (struct udpstats *)malloc(sizeof(struct udpstats));
+		*s->udpstats = udpstats;
+	}
+	return NULL;
+}
+
+/* add the I/O statistics of another thread to those of this one */
+void udpstats_merge(struct udpstats *from)
+{
+	udpstats.nsendmmsg += from->nsendmmsg;
+	udpstats.nrecvmmsg += from->nrecvmmsg;
+	udpstats.nwait += from->nwait;
+	udpstats.nenter += from->nenter;
+	udpstats.nsent += from->nsent;
+	udpstats.nreceived += from->nreceived;
+	udpstats.ndropped += from->ndropped;
+	udpstats.nhandoff += from->nhandoff;
+	hist_merge(&udpstats.wire, &from->wire);
+}
+
+/* shard the flows among nthreads threads, this one running shard 0 */
+void shard_start(void)
+{
+	int *nshardflows = (int *)calloc(nthreads, sizeof(int));
+	int i, j, given = 0, flows = 0;
+
+	arrivalseeds = (unsigned int *)malloc(nflows * sizeof(unsigned int));
+	for (i = 0; i < nflows; i++)
+	{
+		arrivalseeds[i] = 9999 + i;
+		nshardflows[flow_shard(i)]++;
+	}
+	shards = (struct shard *)calloc(nthreads, sizeof(struct shard));
+	nrunning = nthreads;
+	for (i = 0; i < nthreads; i++)
+	{
+		flows += nshardflows[i];
+		shards[i].quota = (int)((long long)nsimmax * flows / nflows) - given;
+		given += shards[i].quota;
+		shards[i].wakefd = eventfd(0, EFD_NONBLOCK);
+		shards[i].inbox = (struct spsc **)calloc(nthreads, sizeof(struct spsc *));
+		for (j = 0; j < nthreads; j++)
+			if (j != i)
+			{
+				shards[i].inbox[j] = (struct spsc *)aligned_alloc(64, sizeof(struct spsc));
+				shards[i].inbox[j]->head = shards[i].inbox[j]->tail = 0;
+			}
+	}
+	for (i = 1; i < nthreads; i++)
+		pthread_create(&shards[i].thread, NULL, shard_run, &shards[i]);
+	shard_run(&shards[0]);
+	for (i = 1; i < nthreads; i++)
+	{
+		pthread_join(shards[i].thread, NULL);
+		nsim += shards[i].nsim;
+		stats_merge(shards[i].stats);
+		udpstats_merge(shards[i].udpstats);
+	}
+	free(nshardflows);
+}
+
+/* run the entities, initialized, in real time */
+void udp_run(void)
+{
+	int n = nthreads > 0 ? nthreads : 1, s;
+
+	udp_open(n);
+	udpsock[A] = udpsocks[0][A];
+	udpsock[B] = udpsocks[0][B];
+	udpgso = gsoable;
+	if (backend == BACKEND_URING && !uring_open())
+	{
+		fprintf(stderr, "io_uring is not available: using epoll\n");
+		backend = BACKEND_UDP;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &udpstart);
+	if (nthreads > 0)
+		shard_start();
+	else if (backend == BACKEND_URING)
+		uring_run();
+	else
+		epoll_run();
+	simtime = udp_now();
+	for (s = 0; s < n; s++)
+	{
+		close(udpsocks[s][A]);
+		close(udpsocks[s][B]);
+	}
+}
+
+/* syscalls_per_datagram counts all the system calls made for I/O */
+void udp_write_stats(FILE *out)
+{
+	struct histogram *h = &udpstats.wire;
+	long long datagrams = udpstats.nsent + udpstats.nreceived;
+	long long syscalls = udpstats.nsendmmsg + udpstats.nrecvmmsg + udpstats.nwait + udpstats.nenter;
+
+	fprintf(out, "{\"backend\": \"%s\", \"time_unit_us\": %f, \"wall_seconds\": %f, \"gso\": %d,\n",
+			backend_names[backend], time_unit, simtime * time_unit / 1e6, udpgso);
+	fprintf(out, "    \"syscalls\": {\"sendmmsg\": %lld, \"recvmmsg\": %lld, \"epoll_wait\": %lld, \"io_uring_enter\": %lld, \"per_datagram\": %f},\n",
+			udpstats.nsendmmsg, udpstats.nrecvmmsg, udpstats.nwait, udpstats.nenter,
+			datagrams > 0 ? (double)syscalls / datagrams : 0.0);
+	fprintf(out, "    \"shards\": %d, \"steered\": %d,\n", nthreads > 0 ? nthreads : 1, steered);
+	fprintf(out, "    \"datagrams\": {\"sent\": %lld, \"received\": %lld, \"dropped\": %lld, \"handed_off\": %lld},\n",
+			udpstats.nsent, udpstats.nreceived, udpstats.ndropped, udpstats.nhandoff);
+	fprintf(out, "    \"wire_latency\": ");
+	hist_write(out, h);
+	fprintf(out, "}");
+}
+
+/****************************** CHECKPOINTS ***************************/
+/* With -k <file>[,<interval>], the whole state of the simulation is   */
+/* written to file every interval time units, when the process gets    */
+/* SIGUSR1, and before it stops on SIGINT or SIGTERM; -K <file>        */
+/* resumes from it.  The state is taken between two events: the event  */
+/* list with the packets in flight, the random number generators, the  */
+/* statistics and streams, the arrival sources, receive buffers and    */
+/* connections, and the protocol's own state, which its checkpoint     */
+/* entry point saves and restores with checkpoint_data().  A run       */
+/* resumed with the same options and answers on stdin ends as it would */
+/* have without stopping, bit for bit; a header checks the options     */
+/* that shape the run: the flows, credits, receive buffers, arrivals,  */
+/* and the impairments of each direction as -l, -c, -G, -E, -R and -D */
+/* left them, and refuses a checkpoint made with others.               */
+/* A checkpoint is written under a temporary name and then renamed, so */
+/* an interrupted write leaves the previous one whole.  For the        */
+/* sequential simulation only: not with -p, -b, -t, -r or -S.          */
+/**********************************************************************/
+
+#define CHECKPOINT_MAGIC "CHECKPT4"
+
+/* what a checkpoint must have been made with to be resumed */
+struct checkpoint_header
+{
+	char magic[8];
+	char protocol[16];
+	int nflows, nsimmax, arrival, sendbuffer, rcvbufsize, connmsgs;
+	float lossprob, corruptprob, lambda, readrate;
+	struct impairment impair[2]; /* as the options and stdin set them */
+	int sizes[4];				 /* of the structures saved whole, for this build */
+};
+
+char *checkpointname = NULL;				 /* -k: where to write checkpoints */
+float checkpoint_interval = 0.0;			 /* time between them, 0 for on signals only */
+float checkpoint_next;						 /* time of the next one */
+char *resumename = NULL;					 /* -K: the checkpoint to resume from */
+FILE *checkpoint_file;						 /* being written or read */
+int checkpoint_restoring;					 /* 1 while it is read */
+volatile sig_atomic_t checkpoint_signal = 0; /* the signal asking for one, or 0 */
+char randstate[128];						 /* state of rand(), see init() */
+
+/* -k file[,interval]: 1 if well formed */
+int checkpoint_parse(char *arg)
+{
+	char *comma = strchr(arg, ',');
+
+	checkpointname = arg;
+	if (comma == NULL)
+		return 1;
+	*comma = '\0';
+	checkpoint_interval = checkpoint_next = atof(comma + 1);
+	return checkpoint_interval > 0;
+}
+
+void checkpoint_handler(int sig)
+{
+	checkpoint_signal = sig;
+}
+
+/* write size bytes at data to the checkpoint, or read them back */
+void checkpoint_data(void *data, int size)
+{
+	size_t done;
+
+	if (size == 0)
+		return;
+	if (checkpoint_restoring)
+		done = fread(data, size, 1, checkpoint_file);
+	else
+		done = fwrite(data, size, 1, checkpoint_file);
+	if (done != 1)
+	{
+		fprintf(stderr, "checkpoint: %s\n", checkpoint_restoring ? "file truncated" : strerror(errno));
+		exit(1);
+	}
+}
+
+/* the state of rand(), which lives in randstate: setstate() records */
+/* in it where rand() is in its table.  It records that in the state  */
+/* being left, so another one is taken while randstate is read back   */
+void checkpoint_rand(void)
+{
+	static char scratch[sizeof(randstate)];
+
+	if (checkpoint_restoring)
+		initstate(1, scratch, sizeof(scratch));
+	else
+		setstate(randstate);
+	checkpoint_data(randstate, sizeof(randstate));
+	if (checkpoint_restoring)
+		setstate(randstate);
+}
+
+/* the event list, with the packets in flight; the running timers are */
+/* its TIMER_INTERRUPT events.  Read back in the order of the heap,   */
+/* the events keep their places and insertion order                   */
+void checkpoint_events(void)
+{
+	struct event *e;
+	int i, n = nevents;
+
+	checkpoint_data(&n, sizeof(n));
+	checkpoint_data(&nevseq, sizeof(nevseq));
+	for (i = 0; i < n; i++)
+	{
+		e = checkpoint_restoring ? (struct event *)malloc(sizeof(struct event)) : evlist[i];
+		checkpoint_data(e, sizeof(struct event));
+		if (e->evtype == FROM_LAYER3)
+		{
+			if (checkpoint_restoring)
+				e->pktptr = (struct pkt *)malloc(sizeof(struct pkt));
+			checkpoint_data(e->pktptr, sizeof(struct pkt));
+		}
+		if (!checkpoint_restoring)
+			continue;
+		if (nevents == evlistsize)
+		{
+			evlistsize = evlistsize ? 2 * evlistsize : 1024;
+			evlist = (struct event **)realloc(evlist, evlistsize * sizeof(struct event *));
+		}
+		heapset(nevents++, e);
+		if (e->evtype == TIMER_INTERRUPT)
+			timers[2 * e->evflow + e->eventity] = e;
+	}
+}
+
+/* copy the impairment from into to field by field, leaving the padding */
+/* of to as it was, so that headers compare whole                        */
+void checkpoint_impairment(struct impairment *to, struct impairment *from)
+{
+	to->lossprob = from->lossprob;
+	to->corruptprob = from->corruptprob;
+	to->gilbert = from->gilbert;
+	to->p = from->p;
+	to->r = from->r;
+	to->lossbad = from->lossbad;
+	to->lossgood = from->lossgood;
+	to->ber = from->ber;
+	to->reorderprob = from->reorderprob;
+	to->spread = from->spread;
+	to->dupprob = from->dupprob;
+}
+
+/* write the state of the simulation to checkpoint_file, or read it back */
+void checkpoint_state(void)
+{
+	struct checkpoint_header header, found;
+	struct stream *s;
+	struct submit *ring;
+	struct arrival *trace;
+	int i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	strncpy(header.protocol, protocol->name, sizeof(header.protocol) - 1);
+	header.nflows = nflows;
+	header.nsimmax = nsimmax;
+	header.arrival = arrival;
+	header.sendbuffer = sendbuffer;
+	header.rcvbufsize = rcvbufsize;
+	header.connmsgs = connmsgs;
+	header.lossprob = lossprob;
+	header.corruptprob = corruptprob;
+	header.lambda = lambda;
+	header.readrate = rcvbufsize > 0 ? readrate : 0;
+	for (i = A; i <= B; i++)
+		checkpoint_impairment(&header.impair[i], &impair[i]);
+	header.sizes[0] = sizeof(struct stats);
+	header.sizes[1] = sizeof(struct event);
+	header.sizes[2] = sizeof(struct stream);
+	header.sizes[3] = sizeof(struct pkt);
+	found = header;
+	checkpoint_data(&found, sizeof(found));
+	if (memcmp(&found, &header, sizeof(header)) != 0)
+	{
+		fprintf(stderr, "checkpoint: made by another protocol, build or options\n");
+		exit(1);
+	}
+
+	checkpoint_data(&simtime, sizeof(simtime));
+	checkpoint_data(&nsim, sizeof(nsim));
+	checkpoint_data(ninflight, sizeof(ninflight));
+	checkpoint_data(lastarrival, sizeof(lastarrival));
+	checkpoint_data(channel_bad, sizeof(channel_bad));
+	checkpoint_rand();
+	if (windowed)
+	{
+		checkpoint_data(arrivalseeds, nflows * sizeof(unsigned int));
+		checkpoint_data(channelseeds, sizeof(channelseeds));
+	}
+	checkpoint_data(&stats, sizeof(stats));
+	for (i = 0; i < 2 * nflows; i++)
+	{
+		s = &streams[i];
+		ring = s->ring;
+		checkpoint_data(s, sizeof(struct stream));
+		if (checkpoint_restoring)
+		{
+			free(ring);
+			s->ring = (struct submit *)malloc(s->size * sizeof(struct submit));
+		}
+		checkpoint_data(s->ring, s->size * sizeof(struct submit));
+	}
+	for (i = 0; i < nflows; i++)
+	{
+		trace = sources[i].trace; /* loaded again by -f */
+		checkpoint_data(&sources[i], sizeof(struct source));
+		sources[i].trace = trace;
+	}
+	checkpoint_data(rcvbufs, 2 * nflows * sizeof(struct rcvbuf));
+	checkpoint_data(connections, nflows * sizeof(struct connection));
+	checkpoint_events();
+	protocol->checkpoint(checkpoint_restoring);
+}
+
+/* write a checkpoint */
+void checkpoint_save(void)
+{
+	char *tmp = (char *)malloc(strlen(checkpointname) + 5);
+
+	sprintf(tmp, "%s.tmp", checkpointname);
+	if ((checkpoint_file = fopen(tmp, "wb")) == NULL)
+	{
+		perror(tmp);
+		exit(1);
+	}
+	checkpoint_restoring = 0;
+	checkpoint_state();
+	if (fclose(checkpoint_file) != 0 || rename(tmp, checkpointname) != 0)
+	{
+		perror(checkpointname);
+		exit(1);
+	}
+	free(tmp);
+}
+
+/* write a checkpoint if one is due before the event at time next; */
+/* returns 1 if the run is to stop after it                        */
+int checkpoint_due(float next)
+{
+	int sig = checkpoint_signal;
+
+	if (sig == 0 && (checkpoint_interval == 0 || next < checkpoint_next))
+		return 0;
+	checkpoint_signal = 0;
+	checkpoint_save();
+	while (checkpoint_interval > 0 && checkpoint_next <= next)
+		checkpoint_next += checkpoint_interval;
+	return sig == SIGINT || sig == SIGTERM;
+}
+
+/* replace the state of the simulation just started by the one saved */
+/* in filename                                                       */
+void checkpoint_resume(char *filename)
+{
+	struct event *e;
+
+	while ((e = nextevent()) != NULL)
+		free(e);
+	if ((checkpoint_file = fopen(filename, "rb")) == NULL)
+	{
+		perror(filename);
+		exit(1);
+	}
+	checkpoint_restoring = 1;
+	checkpoint_state();
+	fclose(checkpoint_file);
+	while (checkpoint_interval > 0 && checkpoint_next <= simtime)
+		checkpoint_next += checkpoint_interval;
+}
+
+/* simulate several flows on this thread alone, in the windows of -p; */
+/* 1 if stopped to checkpoint                                         */
+int windowed_run(void)
+{
+	struct event *eventptr;
+
+	partitions = (struct partition *)calloc(1, sizeof(struct partition));
+	part = partitions;
+	while (nevents > 0)
+	{
+		if (checkpointname != NULL && checkpoint_due(evlist[0]->evtime))
+			return 1;
+		window_end = evlist[0]->evtime + LOOKAHEAD;
+		while (nevents > 0 && evlist[0]->evtime < window_end && nsim < nsimmax)
+		{
+			sample_until(evlist[0]->evtime);
+			eventptr = nextevent();
+			print_event(eventptr);
+			simtime = eventptr->evtime;
+			trace_event(eventptr);
+			if (eventptr->evtype == FROM_LAYER3)
+				ninflight[eventptr->eventity]--;
+			simulate(eventptr);
+		}
+		channel_run();
+		if (nsim >= nsimmax)
+		{
+			if (nevents > 0)
+				simtime = evlist[0]->evtime; /* the first event not simulated, as with -p */
+			trace_pending();
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/*************************** PERFORMANCE REPORT ***********************/
+/* With -P <file>, the cost of the run itself is written to file as a */
+/* single line of JSON, for the macro-benchmarks to collect: the wall  */
+/* time from start to end, the events simulated and their rate, the    */
+/* peak resident set size, and the allocations per msg delivered.      */
+/* Allocations are only counted in a protocol linked with allocs.c     */
+/* ("make macrobench" does so); otherwise they are null.               */
+/**********************************************************************/
+
+char *perfname = NULL;						  /* -P: where to write the performance report */
+double perf_start;							  /* wall time the run started, in seconds */
+extern long long nallocs __attribute__((weak)); /* defined by allocs.c, if linked */
+
+/* wall time in seconds */
+double perf_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* program is the name the protocol was run by, naming its build */
+void perf_write(char *filename, char *program)
+{
+	double wall = perf_now() - perf_start;
+	long long delivered = stats.tally[A].nunique + stats.tally[B].nunique;
+	struct rusage usage;
+	FILE *out = fopen(filename, "w");
+
+	if (out == NULL)
+	{
+		perror(filename);
+		return;
+	}
+	getrusage(RUSAGE_SELF, &usage);
+	if (strrchr(program, '/') != NULL)
+		program = strrchr(program, '/') + 1;
+	fprintf(out, "{\"program\": \"%s\", \"msgs\": %d, \"loss\": %f, \"corrupt\": %f, \"threads\": %d, ",
+			program, nsim, lossprob, corruptprob, nthreads > 0 ? nthreads : 1);
+	fprintf(out, "\"events\": %lld, \"wall_seconds\": %f, \"events_per_second\": %f, \"max_rss_kb\": %ld, \"delivered\": %lld, ",
+			stats.nsimulated, wall, wall > 0 ? stats.nsimulated / wall : 0.0, usage.ru_maxrss, delivered);
+	if (&nallocs != NULL)
+		fprintf(out, "\"allocations\": %lld, \"allocations_per_delivery\": %f}\n",
+				nallocs, delivered > 0 ? (double)nallocs / delivered : 0.0);
+	else
+		fprintf(out, "\"allocations\": null, \"allocations_per_delivery\": null}\n");
+	fclose(out);
+}
+
+/*************************** MICRO-BENCHMARKS *************************/
+/* With -M <file>, nothing is simulated: the hot paths of the emulator */
+/* and of the protocol are timed one at a time instead, and the cost   */
+/* of each is written to file as JSON, one line per benchmark, so that */
+/* runs before and after a change can be compared by a script:         */
+/*   event_hold   take the earliest event and insert it again later,   */
+/*                with depth events in the event list                  */
+/*   timer        starttimer() then stoptimer(), over depth events     */
+/*   tolayer3     a packet given to the channel and its arrival taken  */
+/*                from the event list, over depth events               */
+/*   app_send     a msg given to A that is never acknowledged: the     */
+/*                protocol builds, checksums and queues or sends it    */
+/*   round_trip   a msg through A, the channel, B and back as an ACK,  */
+/*                with in_flight msgs given and not yet acknowledged,  */
+/*                so that each ACK slides the window of A              */
+/* Each line gives the ops timed and their cost in ns, and in ops per  */
+/* second.  The emulator is set up as for a run, with the answers on   */
+/* stdin; "make bench" runs the benchmarks of every protocol.          */
+/**********************************************************************/
+
+#define BENCH_OPS (1 << 20) /* ops timed by each benchmark */
+#define BENCH_LATER 1e9	   /* the events filling the list are due after all that is timed */
+
+char *benchname = NULL; /* -M: run the micro-benchmarks, results to this file */
+
+/* monotonic time in ns */
+double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* write the result of a benchmark, param naming what was varied */
+void bench_report(FILE *out, char *name, char *param, int value, long long ops, double ns)
+{
+	static int first = 1;
+
+	fprintf(out, "%s    {\"name\": \"%s\", \"%s\": %d, \"ops\": %lld, \"ns_per_op\": %f, \"ops_per_second\": %f}",
+			first ? "" : ",\n", name, param, value, ops, ops > 0 ? ns / ops : 0.0, ns > 0 ? ops * 1e9 / ns : 0.0);
+	first = 0;
+}
+
+/* empty the event list, stopping the timers, and restart both entities */
+/* with the msgs given so far forgotten                                   */
+void bench_reset(void)
+{
+	struct stream *s;
+	struct event *e;
+
+	while ((e = nextevent()) != NULL)
+	{
+		if (e->evtype == FROM_LAYER3)
+		{
+			free(e->pktptr);
+			ninflight[e->eventity]--;
+		}
+		free(e);
+	}
+	timers[A] = timers[B] = NULL;
+	for (curflow = A; curflow <= B; curflow++)
+	{
+		if (lastarrival[curflow] > simtime) /* the channel is empty again */
+			simtime = lastarrival[curflow];
+		s = stream_of(0, curflow);
+		s->nsend = s->ndeliver = s->nacked = s->nsubmit;
+		s->seen = 0;
+	}
+	curflow = 0;
+	protocol->A_init();
+	protocol->B_init();
+}
+
+/* fill the event list with depth events from events, due after time from */
+void bench_fill(struct event *events, int depth, float from)
+{
+	int i;
+
+	for (i = 0; i < depth; i++)
+	{
+		events[i].evtime = from + jimsrand() * depth;
+		events[i].evtype = TIMER_INTERRUPT;
+		events[i].eventity = B;
+		events[i].evflow = 0;
+		insertevent(&events[i]);
+	}
+}
+
+/* the event list alone: depth events, each taken and inserted again */
+void bench_event_hold(FILE *out, int depth)
+{
+	struct event *events = (struct event *)malloc(depth * sizeof(struct event));
+	float step[1024];
+	struct event *e;
+	double start;
+	int i;
+
+	for (i = 0; i < 1024; i++)
+		step[i] = 1 + jimsrand() * depth;
+	bench_fill(events, depth, 0.0);
+	start = bench_now();
+	for (i = 0; i < BENCH_OPS; i++)
+	{
+		e = nextevent();
+		e->evtime += step[i & 1023];
+		insertevent(e);
+	}
+	bench_report(out, "event_hold", "depth", depth, BENCH_OPS, bench_now() - start);
+	nevents = 0;
+	free(events);
+}
+
+/* a timer started and stopped by A, over depth events due later */
+void bench_timer(FILE *out, int depth)
+{
+	struct event *events = (struct event *)malloc(depth * sizeof(struct event));
+	double start;
+	int i;
+
+	bench_fill(events, depth, simtime + BENCH_LATER);
+	curflow = 0;
+	start = bench_now();
+	for (i = 0; i < BENCH_OPS; i++)
+	{
+		starttimer(A, 1.0 + (i & 1023));
+		stoptimer(A);
+	}
+	bench_report(out, "timer", "depth", depth, BENCH_OPS, bench_now() - start);
+	nevents = 0;
+	free(events);
+}
+
+/* packets given to the channel by A, each arrival taken as it comes */
+void bench_tolayer3(FILE *out, int depth)
+{
+	struct event *events = (struct event *)malloc(depth * sizeof(struct event));
+	struct pkt packet;
+	struct event *e;
+	double start;
+	int i;
+
+	memset(&packet, 0, sizeof(packet));
+	memset(packet.payload, 'a', MSGSIZE);
+	bench_fill(events, depth, simtime + BENCH_LATER);
+	curflow = 0;
+	start = bench_now();
+	for (i = 0; i < BENCH_OPS; i++)
+	{
+		packet.seqnum = i;
+		tolayer3(A, packet);
+		if (nevents > depth) /* not lost */
+		{
+			e = nextevent();
+			ninflight[e->eventity]--;
+			free(e->pktptr);
+			free(e);
+		}
+	}
+	bench_report(out, "tolayer3", "depth", depth, BENCH_OPS, bench_now() - start);
+	nevents = 0;
+	free(events);
+}
+
+/* msgs given to A by the generator, never acknowledged */
+void bench_app_send(FILE *out)
+{
+	double start;
+	int i;
+
+	bench_reset();
+	start = bench_now();
+	for (i = 0; i < BENCH_OPS / 4; i++)
+		generator_give(A);
+	bench_report(out, "app_send", "in_flight", i, i, bench_now() - start);
+	bench_reset();
+}
+
+/* msgs through A and B and acknowledged, in_flight at a time; stops */
+/* early if the protocol cannot keep that many in flight             */
+void bench_round_trip(FILE *out, int in_flight)
+{
+	struct stream *s = stream_of(0, A);
+	long long first;
+	struct event *e;
+	double start;
+	int credits = sendbuffer;
+
+	bench_reset();
+	sendbuffer = in_flight;
+	first = s->nacked;
+	start = bench_now();
+	while (s->nacked - first < BENCH_OPS / 4)
+	{
+		while (app_credits(A) > 0)
+			generator_give(A);
+		if ((e = nextevent()) == NULL)
+			break;
+		simtime = e->evtime;
+		if (e->evtype == FROM_LAYER3)
+			ninflight[e->eventity]--;
+		simulate(e);
+	}
+	bench_report(out, "round_trip", "in_flight", in_flight, s->nacked - first, bench_now() - start);
+	sendbuffer = credits;
+	bench_reset();
+}
+
+/* run all the micro-benchmarks; returns main()'s exit status */
+int bench_run(char *filename)
+{
+	int depths[] = {1, 10, 100, 1000, 10000, 100000};
+	int i;
+	FILE *out = fopen(filename, "w");
+
+	if (out == NULL)
+	{
+		perror(filename);
+		return 1;
+	}
+	bench_reset();
+	fprintf(out, "{\"protocol\": \"%s\", \"msgsize\": %d, \"benchmarks\": [\n", protocol->name, MSGSIZE);
+	for (i = 0; i < 6; i++)
+		bench_event_hold(out, depths[i]);
+	for (i = 0; i < 6; i += 2)
+		bench_timer(out, depths[i]);
+	for (i = 0; i < 6; i += 2)
+		bench_tolayer3(out, depths[i]);
+	bench_app_send(out);
+	bench_round_trip(out, 1);
+	bench_round_trip(out, 64);
+	fprintf(out, "\n]}\n");
+	fclose(out);
+	return 0;
+}
+
+int emulator_main(struct protocol *p, int argc, char *argv[])
+{
+	struct event *eventptr;
+	int opt;
+	//   char c;
+
+	while ((opt = getopt(argc, argv, "s:vi:S:t:r:n:p:a:f:l:c:G:E:R:D:b:w:q:W:C:M:P:X:k:K:")) != -1)
+		if (opt == 's')
+			statsfile = optarg;
+		else if (opt == 'v')
+			verify_strict = 1;
+		else if (opt == 'i')
+			sample_interval = atof(optarg);
+		else if (opt == 'S')
+			samplefile = optarg;
+		else if (opt == 't')
+			trace_open(optarg);
+		else if (opt == 'r')
+			replayname = optarg;
+		else if (opt == 'n' && atoi(optarg) > 0)
+			nflows = atoi(optarg);
+		else if (opt == 'p' && atoi(optarg) > 0)
+			nthreads = atoi(optarg);
+		else if (opt == 'q' && atoi(optarg) > 0)
+			sendbuffer = atoi(optarg);
+		else if (opt == 'W' && rcvbuf_parse(optarg))
+			;
+		else if (opt == 'C' && atoi(optarg) > 0)
+			connmsgs = atoi(optarg);
+		else if (opt == 'M')
+			benchname = optarg;
+		else if (opt == 'P')
+			perfname = optarg;
+		else if (opt == 'k' && checkpoint_parse(optarg))
+			;
+		else if (opt == 'K')
+			resumename = optarg;
+		else if (opt == 'X')
+		{
+			profiling = 1;
+			profname = optarg;
+		}
+		else if (opt == 'a' && arrival_parse(optarg))
+			;
+		else if (strchr("lcGERD", opt) != NULL && impair_parse(opt, optarg))
+			;
+		else if (opt == 'b' && backend_parse(optarg))
+			;
+		else if (opt == 'w' && atof(optarg) > 0)
+			time_unit = atof(optarg);
+		else if (opt == 'f')
+		{
+			arrival = ARRIVAL_TRACE;
+			arrivalname = optarg;
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-s stats.json] [-v] [-i interval] [-S samples.csv] [-t trace] [-r trace] [-n flows] [-p threads]\n"
+							"       [-a uniform|poisson|pareto|saturate] [-f arrivals]\n"
+							"       [-l [A:|B:]loss] [-c [A:|B:]corrupt] [-G [A:|B:]p,r[,bad[,good]]] [-E [A:|B:]ber]\n"
+							"       [-R [A:|B:]prob,spread] [-D [A:|B:]prob]\n"
+							"       [-b sim|udp|uring] [-w microseconds] [-q msgs]\n"
+							"       [-W msgs,rate] [-C msgs] [-M bench.json] [-P perf.json] [-X profile.json]\n"
+							"       [-k checkpoint[,interval]] [-K checkpoint]\n",
+					argv[0]);
+			return 1;
+		}
+	if (nthreads > 0 && (samplefile != NULL || tracefile != NULL || replayname != NULL))
+	{
+		fprintf(stderr, "%s: -S, -t and -r cannot be used with -p\n", argv[0]);
+		return 1;
+	}
+	if (backend != BACKEND_SIM && (samplefile != NULL || tracefile != NULL || replayname != NULL))
+	{
+		fprintf(stderr, "%s: -S, -t and -r need the simulated channel\n", argv[0]);
+		return 1;
+	}
+	if (benchname != NULL && (nthreads > 0 || backend != BACKEND_SIM || connmsgs > 0))
+	{
+		fprintf(stderr, "%s: -M needs the simulated channel, without -p or -C\n", argv[0]);
+		return 1;
+	}
+	if ((checkpointname != NULL || resumename != NULL) &&
+		(nthreads > 0 || backend != BACKEND_SIM || benchname != NULL ||
+		 samplefile != NULL || tracefile != NULL || replayname != NULL))
+	{
+		fprintf(stderr, "%s: -k and -K need the sequential simulation, without -S, -t, -r or -M\n", argv[0]);
+		return 1;
+	}
+	if ((checkpointname != NULL || resumename != NULL) && p->checkpoint == NULL)
+	{
+		fprintf(stderr, "%s: -k and -K need a protocol that saves its state\n", argv[0]);
+		return 1;
+	}
+	if (connmsgs > 0 && p->A_open == NULL)
+	{
+		fprintf(stderr, "%s: -C needs a protocol that opens connections\n", argv[0]);
+		return 1;
+	}
+	if (backend == BACKEND_SIM && nthreads > 0 && (arrival == ARRIVAL_SATURATE || arrival == ARRIVAL_TRACE))
+	{
+		fprintf(stderr, "%s: -p needs arrivals drawn at random\n", argv[0]);
+		return 1;
+	}
+	if (replayname != NULL)
+	{
+		replay_open(&replay_send[A], replayname);
+		replay_open(&replay_send[B], replayname);
+		replay_open(&replay_arrival, replayname);
+	}
+
+	protocol = p;
+	windowed = backend == BACKEND_SIM && benchname == NULL && (nthreads > 0 || nflows > 1);
+	perf_start = perf_now();
+	prof_start = prof_ticks();
+	clock_gettime(CLOCK_MONOTONIC, &prof_started);
+	init();
+	if (backend == BACKEND_SIM && nthreads > 0)
+	{
+		parallel_run();
+		goto terminate;
+	}
+	for (curflow = 0; curflow < nflows; curflow++)
+	{
+		if (windowed)
+			generate_next_arrival(); /* in the order of partition_run */
+		protocol->A_init();
+		protocol->B_init();
+	}
+	if (benchname != NULL)
+		return bench_run(benchname);
+	if (resumename != NULL)
+		checkpoint_resume(resumename);
+	if (checkpointname != NULL)
+	{
+		signal(SIGUSR1, checkpoint_handler);
+		signal(SIGINT, checkpoint_handler);
+		signal(SIGTERM, checkpoint_handler);
+	}
+	if (backend != BACKEND_SIM)
+	{
+		udp_run();
+		goto terminate;
+	}
+	if (windowed)
+	{
+		if (!windowed_run())
+			goto terminate;
+		fprintf(stderr, "%s: stopped at time %f, checkpoint in %s\n", argv[0], simtime, checkpointname);
+		return 1;
+	}
+
+	while (1)
+	{
+		if (nevents == 0)
+			goto terminate;
+		if (checkpointname != NULL && checkpoint_due(evlist[0]->evtime))
+		{
+			fprintf(stderr, "%s: stopped at time %f, checkpoint in %s\n", argv[0], simtime, checkpointname);
+			return 1;
+		}
+		sample_until(evlist[0]->evtime);
+		eventptr = nextevent(); /* get next event to simulate */
+		print_event(eventptr);
+		simtime = eventptr->evtime; /* update time to next event time */
+		trace_event(eventptr);
+		if (nsim == nsimmax)
+			break; /* all done with simulation */
+		if (eventptr->evtype == FROM_LAYER3)
+			ninflight[eventptr->eventity]--;
+		simulate(eventptr);
+	}
+
+terminate:
+	printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n", simtime, nsim);
+	if (statsfile != NULL)
+		stats_write(statsfile);
+	if (perfname != NULL)
+		perf_write(perfname, argv[0]);
+	if (profname != NULL)
+		prof_write(profname, &stats.profile);
+	if (samplefile != NULL)
+		sample_write(samplefile);
+	if (tracefile != NULL)
+		fclose(tracefile);
+	if (verify_strict)
+	{
+		printf(" Delivery check: %lld failures A to B, %lld failures B to A\n", verify_failures(A), verify_failures(B));
+		if (verify_failures(A) + verify_failures(B) > 0)
+			return 1;
+	}
+	return 0;
+}
+
+void init(void) /* initialize the simulator */
+{
+	int i;
+	float sum, avg;
+
+	printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+	printf("Enter the number of messages to simulate: ");
+	scanf("%d", &nsimmax);
+	printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+	scanf("%f", &lossprob);
+	printf("Enter packet corruption probability [0.0 for no corruption]:");
+	scanf("%f", &corruptprob);
+	printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+	scanf("%f", &lambda);
+	printf("Enter TRACE:");
+	scanf("%d", &TRACE);
+	for (i = A; i <= B; i++) /* what -l and -c did not set */
+	{
+		if (impair[i].lossprob < 0)
+			impair[i].lossprob = lossprob;
+		if (impair[i].corruptprob < 0)
+			impair[i].corruptprob = corruptprob;
+	}
+
+	initstate(9999, randstate, sizeof(randstate)); /* init random number generator, */
+												   /* as srand(9999), in a state that */
+												   /* -k can save                     */
+	sum = 0.0;	 /* test random number generator for students */
+	for (i = 0; i < 1000; i++)
+		sum = sum + jimsrand(); /* jimsrand() should be uniform in [0,1] */
+	avg = sum / 1000.0;
+	if (avg < 0.25 || avg > 0.75)
+	{
+		printf("It is likely that random number generation on your machine\n");
+		printf("is different from what this emulator expects.  Please take\n");
+		printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+		exit(1);
+	}
+
+	timers = (struct event **)calloc(2 * nflows, sizeof(struct event *));
+	streams = (struct stream *)calloc(2 * nflows, sizeof(struct stream));
+	sources = (struct source *)calloc(nflows, sizeof(struct source));
+	rcvbufs = (struct rcvbuf *)calloc(2 * nflows, sizeof(struct rcvbuf));
+	connections = (struct connection *)calloc(nflows, sizeof(struct connection));
+	if (arrivalname != NULL)
+		arrival_load(arrivalname);
+
+	simtime = 0.0; /* initialize time to 0.0 */
+	if (windowed)
+		streams_seed();
+	/* else the arrivals start with the entities of each flow, or with */
+	/* the shard of each flow for -b udp and -b uring with -p          */
+	if (!windowed && nthreads == 0)
+		for (curflow = 0; curflow < nflows; curflow++)
+			generate_next_arrival(); /* initialize event list */
+}
+
+/****************************************************************************/
+/* jimsrand(): return a float in range [0,1].  The routine below is used to */
+/* isolate all random number generation in one location.  We assume that the*/
+/* system-supplied rand() function return an int in therange [0,mmm]        */
+/****************************************************************************/
+float jimsrand(void)
+{
+	double mmm = 2147483647;   /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
+	float x;				   /* individual students may need to change mmm */
+	x = (float)(rand() / mmm); /* x should be uniform in [0,1] */
+	return (x);
+}
+
+/* jimsrand() from the random number stream of seed, or from the one of */
+/* rand() if seed is NULL                                               */
+float jimsrand_r(unsigned int *seed)
+{
+	double mmm = 2147483647;
+
+	if (seed == NULL)
+		return jimsrand();
+	return (float)(rand_r(seed) / mmm);
+}
+
+/********************* EVENT HANDLINE ROUTINES *******/
+/*  The next set of routines handle the event list   */
+/*****************************************************/
+
+/* The event list is a binary min-heap on event time, so inserting and */
+/* removing an event costs O(log n) however many flows are simulated.  */
+/* Events at the same time come out newest first, as they did from the */
+/* sorted list this heap replaces.                                     */
+
+/* 1 if event p must be taken from the event list before event q */
+int eventbefore(struct event *p, struct event *q)
+{
+	if (p->evtime != q->evtime)
+		return p->evtime < q->evtime;
+	return p->evseq > q->evseq;
+}
+
+void heapset(int i, struct event *p)
+{
+	evlist[i] = p;
+	p->heapindex = i;
+}
+
+/* move the event at i towards the root until its parent comes first; */
+/* returns the levels it moved                                        */
+int siftup(int i)
+{
+	struct event *p = evlist[i];
+	int steps = 0;
+
+	while (i > 0 && eventbefore(p, evlist[(i - 1) / 2]))
+	{
+		heapset(i, evlist[(i - 1) / 2]);
+		i = (i - 1) / 2;
+		steps++;
+	}
+	heapset(i, p);
+	return steps;
+}
+
+/* move the event at i towards the leaves until it comes before its children; */
+/* returns the levels it moved                                                */
+int siftdown(int i)
+{
+	struct event *p = evlist[i];
+	int child, steps = 0;
+
+	while ((child = 2 * i + 1) < nevents)
+	{
+		if (child + 1 < nevents && eventbefore(evlist[child + 1], evlist[child]))
+			child++;
+		if (!eventbefore(evlist[child], p))
+			break;
+		heapset(i, evlist[child]);
+		i = child;
+		steps++;
+	}
+	heapset(i, p);
+	return steps;
+}
+
+/* take event p out of the event list */
+void removeevent(struct event *p)
+{
+	long long start = profiling ? prof_ticks() : 0;
+	int i = p->heapindex, steps = 0;
+
+	if (backend != BACKEND_SIM)
+		wheel_remove(p);
+	else
+	{
+		nevents--;
+		if (i != nevents)
+		{
+			heapset(i, evlist[nevents]);
+			steps = siftdown(i);
+			steps += siftup(evlist[i]->heapindex);
+		}
+	}
+	if (profiling)
+	{
+		stats.profile.nremove++;
+		stats.profile.nsteps += steps;
+		stats.profile.listticks += prof_ticks() - start;
+	}
+}
+
+/* take the next event to simulate out of the event list, NULL if empty */
+struct event *nextevent(void)
+{
+	struct event *p;
+
+	if (nevents == 0)
+		return NULL;
+	p = evlist[0];
+	removeevent(p);
+	return p;
+}
+
+/* schedule the next msg from layer 5 to the current flow */
+void generate_next_arrival(void)
+{
+	struct source *src = &sources[curflow];
+	int entity;
+	float when;
+
+	if (TRACE > 2)
+		printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
+
+	if (replay_next(&replay_arrival, TRACE_LAYER5, -1))
+	{
+		curflow = replay_arrival.rec.flow;
+		arrival_schedule(replay_arrival.rec.time, replay_arrival.rec.entity,
+						 replay_arrival.rec.seqnum > 0 ? replay_arrival.rec.seqnum : 1);
+		curflow = src - sources;
+	}
+	else if (arrival == ARRIVAL_TRACE)
+	{
+		if (src->next < src->ntrace)
+		{
+			when = src->trace[src->next].time;
+			arrival_schedule(when > simtime ? when : simtime, A, src->trace[src->next].count);
+			src->next++;
+		}
+	}
+	else if (arrival == ARRIVAL_SATURATE)
+		arrival_topup(A); /* the first one; the others as A sends */
+	else
+	{
+		when = arrival_after(simtime, src, arrivalseeds != NULL ? &arrivalseeds[curflow] : NULL, &entity);
+		arrival_schedule(when, entity, 1);
+	}
+}
+
+void insertevent(struct event *p)
+{
+	long long start = profiling ? prof_ticks() : 0;
+	int steps = 0;
+
+	if (TRACE > 2)
+	{
+		printf("            INSERTEVENT: time is %lf\n", simtime);
+		printf("            INSERTEVENT: future time will be %lf\n", p->evtime);
+	}
+	if (nevents == evlistsize)
+	{
+		evlistsize = evlistsize ? 2 * evlistsize : 1024;
+		evlist = (struct event **)realloc(evlist, evlistsize * sizeof(struct event *));
+	}
+	p->evseq = nevseq++;
+	if (backend != BACKEND_SIM)
+		wheel_insert(p);
+	else
+	{
+		heapset(nevents, p);
+		nevents++;
+		steps = siftup(p->heapindex);
+	}
+	if (profiling)
+	{
+		stats.profile.ninsert++;
+		stats.profile.nsteps += steps;
+		stats.profile.listticks += prof_ticks() - start;
+	}
+}
+
+void printevlist(void)
+{
+	int i;
+
+	printf("--------------\nEvent List Follows:\n");
+	for (i = 0; i < nevents; i++)
+	{
+		printf("Event time: %f, type: %d entity: %d flow: %d\n", evlist[i]->evtime, evlist[i]->evtype,
+			   evlist[i]->eventity, evlist[i]->evflow);
+	}
+	printf("--------------\n");
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+/* flow of the entity being called, for protocols keeping state per flow */
+int getflow(void)
+{
+	return curflow;
+}
+
+/* the next count msgs given to AorB of the current flow are */
+/* acknowledged by the peer: their credits come back          */
+void acked(int AorB, int count)
+{
+	struct stream *s = stream_of(curflow, AorB);
+
+	for (; count > 0 && s->nacked < s->nsubmit; count--)
+	{
+		stats.tally[AorB].nacked++;
+		if (app->acked != NULL)
+			app->acked(AorB, s->nacked);
+		s->nacked++;
+		if (connmsgs > 0 && AorB == A && connections[curflow].state == CONN_CLOSING &&
+			s->nacked == connections[curflow].end)
+			hist_record(&stats.completion, simtime - connections[curflow].opened);
+	}
+}
+
+/* the connection of AorB of the current flow is established */
+void connected(int AorB)
+{
+	struct connection *c = &connections[curflow];
+
+	if (connmsgs > 0 && AorB == A && c->state == CONN_OPENING)
+	{
+		c->state = CONN_OPEN;
+		hist_record(&stats.setup, simtime - c->opened);
+	}
+	if (app->connected != NULL)
+		app->connected(AorB);
+}
+
+/* the connection of AorB of the current flow is closed */
+void closed(int AorB)
+{
+	struct connection *c = &connections[curflow];
+
+	if (connmsgs > 0 && AorB == A && c->state == CONN_CLOSING)
+	{
+		c->state = CONN_CLOSED;
+		stats.nconnections++;
+		hist_record(&stats.lifetime, simtime - c->opened);
+	}
+	if (app->closed != NULL)
+		app->closed(AorB);
+}
+
+/* room in the receive buffer of AorB of the current flow, in msgs */
+int getrwnd(int AorB)
+{
+	if (rcvbufsize == 0)
+		return RWND_MAX;
+	return rcvbufsize - rcvbufs[2 * curflow + AorB].used;
+}
+
+/* number of flows, each with its own A and B */
+int getnflows(void)
+{
+	return nflows;
+}
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB)
+/* A or B is trying to stop timer */
+{
+	struct event *q = timers[2 * curflow + AorB];
+
+	if (TRACE > 2)
+		printf("          STOP TIMER: stopping timer at %f\n", simtime);
+	if (q == NULL)
+	{
+		printf("Warning: unable to cancel your timer. It wasn't running.\n");
+		return;
+	}
+	/* remove this event */
+	removeevent(q);
+	free(q);
+	timers[2 * curflow + AorB] = NULL;
+	stats.ntimerstop[AorB]++;
+}
+
+void starttimer(int AorB, float increment)
+/* A or B is trying to stop timer */
+
+{
+	struct event *evptr;
+
+	if (TRACE > 2)
+		printf("          START TIMER: starting timer at %f\n", simtime);
+	/* be nice: check to see if timer is already started, if so, then  warn */
+	if (timers[2 * curflow + AorB] != NULL)
+	{
+		printf("Warning: attempt to start a timer that is already started\n");
+		return;
+	}
+
+	/* create future event for when timer goes off */
+	evptr = (struct event *)malloc(sizeof(struct event));
+	evptr->evtime = simtime + increment;
+	evptr->evtype = TIMER_INTERRUPT;
+	evptr->eventity = AorB;
+	evptr->evflow = curflow;
+	insertevent(evptr);
+	timers[2 * curflow + AorB] = evptr;
+	stats.ntimerstart[AorB]++;
+}
+
+/************************** TOLAYER3 ***************/
+
+/* decide what the channel does to the packet AorB is sending: whether it */
+/* is lost, how long beyond 1 time unit after the previous arrival it    */
+/* arrives, and how it is corrupted (with the pattern of the flipped     */
+/* bits in *bits for -E); *flags tells whether it is held back and       */
+/* whether a copy follows, unless it is a copy itself.  Taken from the    */
+/* replayed trace if there is one.                                        */
+int channel_decide(int AorB, int copy, int *flags, float *delay, unsigned int *bits)
+{
+	unsigned int *seed = nthreads > 0 || windowed ? &channelseeds[AorB] : NULL;
+	struct impairment *m = &impair[AorB];
+	float x;
+
+	if (replay_next(&replay_send[AorB], TRACE_SEND, AorB))
+	{
+		*delay = replay_send[AorB].rec.delay;
+		*bits = replay_send[AorB].rec.bits;
+		*flags = replay_send[AorB].rec.flags;
+		return replay_send[AorB].rec.decision;
+	}
+
+	/* simulate duplication: */
+	if (!copy && m->dupprob > 0 && jimsrand_r(seed) < m->dupprob)
+		*flags |= CHANNEL_DUPLICATE;
+
+	/* simulate losses: */
+	if (m->gilbert)
+	{
+		if (jimsrand_r(seed) < (channel_bad[AorB] ? m->r : m->p))
+			channel_bad[AorB] = !channel_bad[AorB];
+		if (jimsrand_r(seed) < (channel_bad[AorB] ? m->lossbad : m->lossgood))
+			return CHANNEL_LOST;
+	}
+	else if (jimsrand_r(seed) < m->lossprob)
+		return CHANNEL_LOST;
+	*delay = 9 * jimsrand_r(seed);
+
+	/* simulate reordering: */
+	if (m->reorderprob > 0 && jimsrand_r(seed) < m->reorderprob)
+	{
+		*flags |= CHANNEL_REORDER;
+		*delay += m->spread * jimsrand_r(seed);
+	}
+
+	/* simulate corruption: */
+	if (m->ber > 0)
+	{
+		*bits = (unsigned int)(jimsrand_r(seed) * (double)UINT_MAX);
+		return ber_corrupts(m->ber, *bits) ? CHANNEL_CORRUPT_BITS : CHANNEL_OK;
+	}
+	if (jimsrand_r(seed) < m->corruptprob)
+	{
+		if ((x = jimsrand_r(seed)) < .75)
+			return CHANNEL_CORRUPT_PAYLOAD;
+		else if (x < .875)
+			return CHANNEL_CORRUPT_SEQNUM;
+		else
+			return CHANNEL_CORRUPT_ACKNUM;
+	}
+	return CHANNEL_OK;
+}
+
+/* AorB of the current flow gives a packet carrying what to layer 3 */
+void layer3_send(int AorB, struct pkt *packet, int what)
+{
+	stats_send(AorB, what);
+	arrival_topup(AorB);
+	if (windowed)
+		outbox_post(AorB, packet); /* the channel takes it at the end of the window */
+	else
+		channel_send(AorB, packet);
+}
+
+void tolayer3(int AorB, struct pkt packet) /* A or B is trying to stop timer */
+{
+	layer3_send(AorB, &packet, SEND_CONTROL);
+}
+
+void tolayer3_msg(int AorB, struct pkt packet, int resend)
+{
+	layer3_send(AorB, &packet, resend ? SEND_RESEND : SEND_FIRST);
+}
+
+/* the channel takes the packet that AorB of the current flow is giving */
+/* to layer 3 at the current time                                       */
+void channel_send(int AorB, struct pkt *packetptr)
+{
+	stats.ntolayer3++;
+	if (channel_carry(AorB, packetptr, 0) & CHANNEL_DUPLICATE)
+	{
+		stats.nduplicated++;
+		if (TRACE > 0)
+			printf("          TOLAYER3: packet being duplicated\n");
+		channel_carry(AorB, packetptr, 1);
+	}
+}
+
+/* carry the packet, or a copy of it, to the other side; returns the */
+/* CHANNEL_REORDER and CHANNEL_DUPLICATE flags of the decision       */
+int channel_carry(int AorB, struct pkt *packetptr, int copy)
+{
+	struct pkt packet = *packetptr;
+	struct pkt *mypktptr;
+	struct event *evptr;
+	//  char *malloc();
+	float lastime, delay;
+	unsigned int bits = 0;
+	int i, decision, flags = 0;
+
+	decision = channel_decide(AorB, copy, &flags, &delay, &bits);
+
+	/* simulate losses: */
+	if (decision == CHANNEL_LOST)
+	{
+		trace_write(TRACE_SEND, AorB, curflow, &packet, decision, flags, 0.0, 0);
+		stats.nlost++;
+		if (TRACE > 0)
+			printf("          TOLAYER3: packet being lost\n");
+		return flags;
+	}
+
+	/* make a copy of the packet student just gave me since he/she may decide */
+	/* to do something with the packet after we return back to him/her */
+	mypktptr = (struct pkt *)malloc(sizeof(struct pkt));
+	mypktptr->flow = curflow; /* the header names the flow of the sender */
+	mypktptr->seqnum = packet.seqnum;
+	mypktptr->acknum = packet.acknum;
+	mypktptr->rwnd = packet.rwnd;
+	mypktptr->checksum = packet.checksum;
+	for (i = 0; i < 20; i++)
+		mypktptr->payload[i] = packet.payload[i];
+	if (TRACE > 2)
+	{
+		printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
+			   mypktptr->acknum, mypktptr->checksum);
+		for (i = 0; i < 20; i++)
+			printf("%c", mypktptr->payload[i]);
+		printf("\n");
+	}
+
+	/* create future event for arrival of packet at the other side */
+	evptr = (struct event *)malloc(sizeof(struct event));
+	evptr->evtype = FROM_LAYER3;	  /* packet will pop out from layer3 */
+	evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
+	evptr->evflow = curflow;
+	evptr->pktptr = mypktptr;		  /* save ptr to my copy of packet */
+									  /* finally, compute the arrival time of packet at the other end.
+   medium can not reorder, so make sure packet arrives between 1 and 10
+   time units after the latest arrival time of packets
+   currently in the medium on their way to the destination.
+   All flows share the medium in each direction.  A packet held
+   back by -R does not move that time, so later ones overtake it. */
+	lastime = simtime;
+	if (lastarrival[evptr->eventity] > lastime) /* not yet arrived */
+		lastime = lastarrival[evptr->eventity];
+	evptr->evtime = lastime + 1 + delay;
+	if (flags & CHANNEL_REORDER)
+	{
+		stats.nreordered++;
+		if (TRACE > 0)
+			printf("          TOLAYER3: packet being held back\n");
+	}
+	else
+		lastarrival[evptr->eventity] = evptr->evtime;
+	stats_channel(evptr->eventity, evptr->evtime);
+	trace_write(TRACE_SEND, AorB, curflow, &packet, decision, flags, delay, bits);
+
+	/* simulate corruption: */
+	if (decision != CHANNEL_OK)
+	{
+		stats.ncorrupt++;
+		if (decision == CHANNEL_CORRUPT_PAYLOAD)
+			mypktptr->payload[0] = 'Z'; /* corrupt payload */
+		else if (decision == CHANNEL_CORRUPT_SEQNUM)
+			mypktptr->seqnum = 999999;
+		else if (decision == CHANNEL_CORRUPT_ACKNUM)
+			mypktptr->acknum = 999999;
+		else
+			ber_flip(mypktptr, impair[AorB].ber, bits);
+		if (TRACE > 0)
+			printf("          TOLAYER3: packet being corrupted\n");
+	}
+
+	if (TRACE > 2)
+		printf("          TOLAYER3: scheduling arrival on other side\n");
+	if (backend == BACKEND_SIM && nthreads > 0)
+		inbox_post(evptr);
+	else
+	{
+		if (backend != BACKEND_SIM)
+			evptr->evtype = TO_WIRE; /* held until its arrival time */
+		insertevent(evptr);
+		ninflight[evptr->eventity]++;
+	}
+	return flags;
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+	int i;
+	long long index;
+
+	if (rcvbufsize > 0 && !rcvbuf_put(AorB))
+		return;
+	index = verify_deliver(AorB, datasent);
+
+	if (index >= 0)
+	{
+		hist_record(&stats.tally[(AorB + 1) % 2].latency,
+					simtime - stream_msg(stream_of(curflow, (AorB + 1) % 2), index)->time);
+		if (app->delivered != NULL)
+			app->delivered(AorB, index);
+	}
+	if (TRACE > 2)
+	{
+		printf("          TOLAYER5: data received: ");
+		for (i = 0; i < 20; i++)
+			printf("%c", datasent[i]);
+		printf("\n");
+	}
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+/* ******************************************************************
+ ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
+
+   This code should be used for PA2, unidirectional or bidirectional
+   data transfer protocols (from A to B. Bidirectional transfer of data
+   is for extra credit and is not required).  Network properties:
+   - one way network delay averages five time units (longer if there
+     are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+     or lost, according to user-defined probabilities, set for each
+     direction if need be; losses can come in bursts (-G) and bit
+     errors hit any field but the flow (-E)
+   - packets will be delivered in the order in which they were sent
+     (although some can be lost), unless reordering (-R) or
+     duplication (-D) is asked for.
+   - with -n, several flows, each with its own A and B, share the
+     channel; the flow field of a packet is set by the emulator.
+   - layer 5 is an application that never blocks: with -q, each sender
+     holds a bounded number of msgs, and gets more as the protocol
+     reports them acknowledged with acked().
+   - with -W, msgs given to tolayer5() wait in a receive buffer of
+     bounded size that the application reads at a fixed rate; a
+     protocol must not deliver when getrwnd() is 0.
+   - with -C, A sends its msgs over short connections, one after the
+     other, that the protocol opens and closes when asked.
+   - with -k, the simulation can be stopped and resumed with -K; the
+     protocol saves and restores its state when asked.
+
+   The emulator is built once as libemulator.a.  A protocol is a small
+   module that fills in a struct protocol with its entry points and
+   calls emulator_main() from its main().
+**********************************************************************/
+
+#define OFF 0
+#define ON 1
+#define A 0
+#define B 1
+
+#define MSGSIZE 20
+
+/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
+/* 4 (students' code).  It contains the data (characters) to be delivered */
+/* to layer 5 via the students transport level protocol entities.         */
+struct msg
+{
+	char data[MSGSIZE];
+};
+
+/* a packet is the data unit passed from layer 4 (students code) to layer */
+/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
+/* students must follow. */
+struct pkt
+{
+	int flow; /* filled in by tolayer3 */
+	int seqnum;
+	int acknum;
+	int rwnd; /* room in the receive buffer of the sender, in msgs */
+	int checksum;
+	char payload[MSGSIZE];
+};
+
+/* the entry points of the two protocol entities, called by the emulator */
+struct protocol
+{
+	char *name;
+	int bidirectional; /* 1 if B also gets msgs from layer 5 (B_output) */
+	void (*A_output)(struct msg message);
+	void (*A_input)(struct pkt packet);
+	void (*A_timerinterrupt)(void);
+	void (*A_init)(void);
+	void (*B_output)(struct msg message);
+	void (*B_input)(struct pkt packet);
+	void (*B_timerinterrupt)(void);
+	void (*B_init)(void);
+	/* optional: the application read half of a receive buffer that */
+	/* was full, so the entity may tell its peer with a window update */
+	void (*A_windowupdate)(void);
+	void (*B_windowupdate)(void);
+	/* optional, for -C: A opens a connection to B, and closes it once */
+	/* the msgs given are acknowledged                                  */
+	void (*A_open)(void);
+	void (*A_close)(void);
+	/* optional, for -k and -K: saves (restoring 0) or restores the state */
+	/* of the entities of all flows with checkpoint_data()                 */
+	void (*checkpoint)(int restoring);
+};
+
+/* routines of the emulator that the students' code may call. They must be */
+/* declared before use: an implicit declaration passes the float timer     */
+/* increment as an int, and the timer fires at a garbage time.             */
+void starttimer(int AorB, float increment);
+void stoptimer(int AorB);
+void tolayer3(int AorB, struct pkt packet);
+/* tolayer3() of a packet carrying a msg given to AorB: the next one not */
+/* yet sent, or, with resend, one sent before; the statistics count the  */
+/* msgs sent and the retransmissions from these, and -a saturate tops    */
+/* the sender up as its msgs go out                                      */
+void tolayer3_msg(int AorB, struct pkt packet, int resend);
+void tolayer5(int AorB, char datasent[20]);
+int getflow(void);	 /* flow of the entity being called, 0 .. getnflows()-1 */
+int getnflows(void); /* number of flows */
+int getrwnd(int AorB); /* room in the receive buffer of AorB, RWND_MAX without -W */
+void acked(int AorB, int count); /* the next count msgs given to AorB were acknowledged */
+void connected(int AorB);		 /* the connection of AorB is established */
+void closed(int AorB);			 /* ... is closed, after TIME_WAIT for the closer */
+void checkpoint_data(void *data, int size); /* writes size bytes at data to the checkpoint, or reads them back */
+
+#define RWND_MAX 65535
+
+#define APP_QUEUED 0	 /* app_send(): the protocol took the msg */
+#define APP_WOULDBLOCK 1 /* no credit left: wait for writable() */
+
+/* the application at layer 5, called back for each entity of the flow */
+/* given by getflow(); a NULL callback is not called                   */
+struct application
+{
+	void (*arrival)(int AorB);				   /* the arrival process has a msg for AorB */
+	void (*writable)(int AorB);				   /* AorB has credit again after APP_WOULDBLOCK */
+	void (*acked)(int AorB, long long id);	   /* msg id given to AorB was acknowledged */
+	void (*delivered)(int AorB, long long id); /* msg id of the peer was delivered to AorB */
+	void (*connected)(int AorB);			   /* the connection of AorB is established */
+	void (*closed)(int AorB);				   /* ... is closed */
+};
+
+/* routines of the emulator that the application may call */
+int app_send(int AorB, struct msg message, long long *id); /* APP_QUEUED or APP_WOULDBLOCK */
+int app_credits(int AorB);								   /* msgs app_send() takes now */
+void app_register(struct application *app);				   /* before emulator_main() */
+void app_open(void);  /* -C: A opens a connection to B */
+void app_close(void); /* ... and closes it */
+
+/* runs the simulation of protocol p; returns main()'s exit status */
+int emulator_main(struct protocol *p, int argc, char *argv[]);
+
+#endif
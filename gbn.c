@@ -1,56 +1,20 @@
-#include <stdio.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
-/* ******************************************************************
- ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-
-   This code should be used for PA2, unidirectional or bidirectional
-   data transfer protocols (from A to B. Bidirectional transfer of data
-   is for extra credit and is not required).  Network properties:
-   - one way network delay averages five time units (longer if there
-     are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-     or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-     (although some can be lost).
-**********************************************************************/
-
-#define BIDIRECTIONAL 0 /* change to 1 if you're doing extra credit */
-						/* and write a routine called B_output */
-
-/* possible events: */
-#define TIMER_INTERRUPT 0
-#define FROM_LAYER5 1
-#define FROM_LAYER3 2
-
-#define OFF 0
-#define ON 1
-#define A 0
-#define B 1
+#include "emulator.h"
 
+#ifndef WINDOWSIZE // Sem -N; make CFLAGS=-DWINDOWSIZE=... para outro padrão
 #define WINDOWSIZE 20
-#define MSGSIZE 20
+#endif
 #define TIMEOUT 500
 #define ACK "ACK"
-
-/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
-/* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
-struct msg
-{
-	char data[MSGSIZE];
-};
-
-/* a packet is the data unit passed from layer 4 (students code) to layer */
-/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
-struct pkt
-{
-	int seqnum;
-	int acknum;
-	int checksum;
-	char payload[MSGSIZE];
-};
+#define SYN "SYN"
+#define SYNACK "SYNACK"
+#define FIN "FIN"
+#define FINACK "FINACK"
+#define MSL TIMEOUT // Vida máxima de um pacote no canal: A fica 2*MSL em TIME_WAIT
+#define PROBE_MAX (16 * TIMEOUT) // Maior intervalo entre sondas de janela zero
 
 // *******************************************************************************
 // *******************************************************************************
@@ -58,48 +22,145 @@ struct pkt
 // *******************************************************************************
 // *******************************************************************************
 
-// Janela de envio, indicando o pacote a ser enviado e o próximo a ser enviado */
-struct window
+// Espaço de números de sequência com SEQBITS bits. Os seqnums dão a volta
+// (wraparound) e são comparados com aritmética serial (RFC 1982), então
+// simulações longas não estouram o int nem confundem ACKs antigos com novos.
+#ifndef SEQBITS
+#define SEQBITS 32
+#endif
+#define SEQMASK ((unsigned int)((1ULL << SEQBITS) - 1))
+
+// A comparação serial só é definida para distâncias menores que metade do espaço
+#if SEQBITS < 2 || SEQBITS > 32
+#error "SEQBITS deve estar entre 2 e 32"
+#endif
+#if WINDOWSIZE >= (1ULL << (SEQBITS - 1))
+#error "WINDOWSIZE deve ser menor que metade do espaço de sequência"
+#endif
+
+// Estados de uma conexão (-C), com os nomes do TCP. ESTABLISHED é 0 para que,
+// sem -C, as entidades comecem e fiquem conectadas como sempre
+#define ESTABLISHED 0
+#define CLOSED 1 // Em B, esperando um SYN (LISTEN)
+#define SYN_SENT 2
+#define SYN_RCVD 3
+#define FIN_WAIT 4
+#define TIME_WAIT 5
+#define LAST_ACK 6
+
+// Fila de envio de uma entidade: os pacotes ainda sem ACK, os em voo primeiro, num anel
+// que dobra quando enche. Cada campo fica num vetor próprio (structure of arrays): o ACK
+// e o timeout percorrem só os metadados, contíguos, e os payloads ficam à parte
+struct queue
+{
+	int size;	 // Capacidade do anel, potência de 2 (0 antes do primeiro pacote)
+	int head;	 // Posição da base (primeiro sem ACK)
+	int count;	 // Pacotes na fila
+	int nsent;	 // Pacotes em voo, a partir da base; o seguinte é o próximo a enviar
+	int *seqnum; // Metadados de cada posição
+	int *checksum;
+	char (*payload)[MSGSIZE];
+};
+
+// Estado de uma conexão: cada fluxo (flow) do emulador tem o seu
+struct conn
 {
-	struct pkt *packet;
-	struct window *next;
+	// Filas de envio de A e B
+	struct queue A_queue;
+	struct queue B_queue;
+
+	// Auxiliar para contar o próximo seqnum esperado
+	int A_expect_seqnum;
+	int B_expect_seqnum;
+	// Auxiliar para contar o próximo seqnum a ser usado
+	int A_next_seqnum;
+	int B_next_seqnum;
+	// Seqnum do próximo pacote de A ainda não enviado (fim da janela em voo)
+	int A_send_seqnum;
+	// Janela anunciada por B no último ACK (espaço no buffer de recepção)
+	int A_rwnd;
+	// Timer ligado como persist timer: janela de B zerada e nada em voo
+	int A_persist;
+	// Espera até a próxima sonda de janela zero, dobrada a cada sonda sem resposta
+	int A_probe;
+
+	// Conexão (-C): estado de cada lado e o último pacote de controle, para reenvio
+	int A_state;
+	int B_state;
+	int A_closing; // A aplicação pediu o fechamento: o FIN sai quando tudo tiver ACK
+	int A_isn;	   // Seqnum do SYN de A; os dados começam no seguinte
+	int A_fin;	   // Seqnum do FIN de A
+	int B_isn;	   // Seqnum do SYNACK de B; o FINACK usa o seguinte
+	int B_peer_isn; // Seqnum do SYN aceito por B
+	int nisn;		// ISNs já escolhidos neste fluxo
+	struct pkt A_control;
+	struct pkt B_control;
 };
+struct conn *conns = NULL; // Uma conexão por fluxo, alocadas no primeiro uso
+
+// Conexão do fluxo sendo chamado pelo emulador
+struct conn *conn(void)
+{
+	if (conns == NULL)
+		conns = (struct conn *)calloc(getnflows(), sizeof(struct conn));
+	return &conns[getflow()];
+}
+
+// Próximo seqnum, com wraparound no espaço de SEQBITS bits
+int seq_next(int seqnum)
+{
+	return (int)(((unsigned int)seqnum + 1) & SEQMASK);
+}
+
+// Seqnum anterior, com wraparound
+int seq_prev(int seqnum)
+{
+	return (int)(((unsigned int)seqnum - 1) & SEQMASK);
+}
 
-// Auxiliares para controle de janela de A e B
-struct window *A_baseWindow = NULL; // Base de envio de A
-struct window *A_endWindow = NULL;	// Final de envio de A
-struct window *B_baseWindow = NULL; // Base de envio de B
-struct window *B_endWindow = NULL;	// Final de envio de B
+// Distância com sinal de b até a no espaço de sequência (RFC 1982)
+int seq_diff(int a, int b)
+{
+	unsigned int diff = ((unsigned int)a - (unsigned int)b) << (32 - SEQBITS);
+	return (int)diff >> (32 - SEQBITS);
+}
+
+// Verifica se o seqnum está dentro da janela [base, end)
+int seq_in_window(int seqnum, int base, int end)
+{
+	return seq_diff(seqnum, base) >= 0 && seq_diff(end, seqnum) > 0;
+}
 
-// Último ACK recebido de A e B
-struct pkt *A_last_ack = NULL;
-struct pkt *B_last_ack = NULL;
+// Escolhe o número de sequência inicial (ISN) de uma conexão de AorB. É determinístico,
+// para a simulação ser reprodutível, mas distinto para cada conexão e fluxo, para que
+// pacotes atrasados de uma conexão não sejam aceitos na seguinte
+int choose_isn(int AorB)
+{
+	struct conn *c = conn();
+	unsigned int k = (c->nisn++ * getnflows() + getflow()) * 2 + AorB + 1;
 
-// Auxiliar para contar o próximo seqnum esperado
-int A_expect_seqnum = 0;
-int B_expect_seqnum = 0;
-// Auxiliar para contar o próximo seqnum a ser usado
-int A_next_seqnum = 0;
-int B_next_seqnum = 0;
+	return (int)((k * 2654435761u) & SEQMASK);
+}
 
 // Calcula o checksum do pacote
 int calc_checksum(struct pkt *packet)
 {
-	int checksum = 0;
+	unsigned int checksum = 0; // unsigned: seqnums de 32 bits não podem estourar a soma
 	checksum += packet->seqnum;
 	checksum += packet->acknum;
+	checksum += packet->rwnd;
 	for (int i = 0; i < MSGSIZE; i++)
 		checksum += packet->payload[i];
 
-	return checksum;
+	return (int)checksum;
 }
 
-// Cria um novo pacote com base num seqnum e um payload
-struct pkt *build_packet(int seqnum, char data[])
+// Monta em packet um pacote com base num seqnum e um payload
+void build_packet(struct pkt *packet, int seqnum, char data[])
 {
-	struct pkt *packet = (struct pkt *)malloc(sizeof(struct pkt));
 	packet->seqnum = seqnum;
 	packet->acknum = 0;
+	packet->rwnd = 0;
 
 	// Copia o payload
 	for (int i = 0; i < MSGSIZE; i++)
@@ -107,58 +168,309 @@ struct pkt *build_packet(int seqnum, char data[])
 
 	// calcula checksum
 	packet->checksum = calc_checksum(packet);
-	return packet;
 }
 
-// Envia um ACK de AorB do packet para o outro lado
-void send_ack(int AorB, struct pkt *packet)
+// Posição no anel do i-ésimo pacote da fila, a partir da base
+int queue_slot(struct queue *q, int i)
+{
+	return (q->head + i) & (q->size - 1);
+}
+
+// Esvazia a fila, mantendo o anel para os próximos pacotes
+void queue_clear(struct queue *q)
+{
+	q->head = 0;
+	q->count = 0;
+	q->nsent = 0;
+}
+
+// Põe no fim da fila o pacote de dados com o seqnum e o payload dados
+void queue_push(struct queue *q, int seqnum, char data[])
+{
+	if (q->count == q->size) // Cheio: dobra o anel, desfazendo a volta
+	{
+		int size = q->size ? 2 * q->size : 16;
+		int *seqnums = (int *)malloc(size * sizeof(int));
+		int *checksums = (int *)malloc(size * sizeof(int));
+		char(*payloads)[MSGSIZE] = (char(*)[MSGSIZE])malloc(size * MSGSIZE);
+
+		for (int i = 0; i < q->count; i++)
+		{
+			int slot = queue_slot(q, i);
+			seqnums[i] = q->seqnum[slot];
+			checksums[i] = q->checksum[slot];
+			memcpy(payloads[i], q->payload[slot], MSGSIZE);
+		}
+		free(q->seqnum);
+		free(q->checksum);
+		free(q->payload);
+		q->seqnum = seqnums;
+		q->checksum = checksums;
+		q->payload = payloads;
+		q->size = size;
+		q->head = 0;
+	}
+
+	int slot = queue_slot(q, q->count++);
+	struct pkt packet;
+	build_packet(&packet, seqnum, data);
+	q->seqnum[slot] = seqnum;
+	q->checksum[slot] = packet.checksum;
+	memcpy(q->payload[slot], data, MSGSIZE);
+}
+
+// Monta em packet o i-ésimo pacote da fila, a partir da base
+void queue_packet(struct queue *q, int i, struct pkt *packet)
+{
+	int slot = queue_slot(q, i);
+
+	packet->seqnum = q->seqnum[slot];
+	packet->acknum = 0;
+	packet->rwnd = 0;
+	packet->checksum = q->checksum[slot];
+	memcpy(packet->payload, q->payload[slot], MSGSIZE);
+}
+
+// Tira da fila os n primeiros pacotes, confirmados
+void queue_pop(struct queue *q, int n)
+{
+	q->head = queue_slot(q, n);
+	q->count -= n;
+	q->nsent -= n;
+}
+
+// Envia um ACK de AorB até o acknum para o outro lado, anunciando a janela de AorB
+void send_ack(int AorB, int acknum)
 {
 	char msg[MSGSIZE] = "ACK";
-	struct pkt *ack_packet = build_packet(packet->seqnum, msg);
-	ack_packet->acknum = packet->seqnum;
+	struct pkt ack_packet;
+	build_packet(&ack_packet, acknum, msg);
+	ack_packet.acknum = acknum;
+	ack_packet.rwnd = getrwnd(AorB);
 
-	// Recalcula checksum com novos dados do ACKNUM
-	ack_packet->checksum = calc_checksum(ack_packet);
+	// Recalcula checksum com novos dados do ACKNUM e da janela
+	ack_packet.checksum = calc_checksum(&ack_packet);
 
 	// Envia
-	tolayer3(AorB, *ack_packet);
+	tolayer3(AorB, ack_packet);
 }
 
-// Envia um pacote de AorB para o outro lado, e cria um timeout
-void send_packet(int AorB, struct pkt *packet)
+// Verifica se o pacote é de controle do tipo kind (SYN, SYNACK, FIN ou FINACK)
+int is_control(struct pkt *packet, char *kind)
+{
+	return strncmp(packet->payload, kind, MSGSIZE) == 0;
+}
+
+// Envia um pacote de controle de AorB, guardando-o para reenvio até ser confirmado
+void send_control(int AorB, int seqnum, int acknum, char *kind)
+{
+	struct conn *c = conn();
+	char msg[MSGSIZE] = {0};
+	strncpy(msg, kind, MSGSIZE - 1);
+	struct pkt *packet = AorB == A ? &c->A_control : &c->B_control;
+	build_packet(packet, seqnum, msg);
+	packet->acknum = acknum;
+	packet->rwnd = getrwnd(AorB);
+	packet->checksum = calc_checksum(packet);
+
+	printf("[%c] %s enviado.\n", AorB == A ? 'A' : 'B', kind);
+	tolayer3(AorB, *packet);
+}
+
+// Envia um pacote de dados de AorB para o outro lado; resend diz ao emulador se é
+// uma retransmissão ou a primeira vez da próxima mensagem
+// O timer é controlado por quem chama, já que só existe um timer por entidade
+void send_packet(int AorB, struct pkt *packet, int resend)
 {
 	if (AorB == A)
 		printf("[A] Pacote enviado.\n");
 	else if (AorB == B)
 		printf("[B] Pacote enviado.\n");
 
-	tolayer3(AorB, *packet);
-	starttimer(AorB, TIMEOUT);
+	tolayer3_msg(AorB, *packet, resend);
 }
 
-// Mensagem que veio de cima, envia para baixo...
-// Recebe mensagem e envia um pacote para B
-void A_output(struct msg message)
+// Envia o próximo pacote da fila de A
+void A_send_next(void)
 {
-	printf("[A] Mensagem recebida.\n");
+	struct conn *c = conn();
+
+	struct pkt packet;
 
-	struct pkt *packet = build_packet(A_next_seqnum, message.data);
-	struct window *newElement = (struct window *)malloc(sizeof(struct window));
-	newElement->packet = packet;
-	newElement->next = NULL;
+	if (c->A_queue.nsent == 0) // Primeiro pacote em voo, liga o timer
+		starttimer(A, TIMEOUT);
+
+	queue_packet(&c->A_queue, c->A_queue.nsent++, &packet);
+	send_packet(A, &packet, 0);
+	c->A_send_seqnum = seq_next(c->A_send_seqnum);
+}
+
+// Tamanho da janela de envio: WINDOWSIZE, ou o escolhido com -N
+int window_size = WINDOWSIZE;
+
+// Envia os pacotes da fila de A enquanto couberem na janela e na janela anunciada por B
+// Com a janela de B zerada e nada em voo, liga o persist timer: se a atualização de
+// janela de B não chegar antes, um pacote vai como sonda (zero-window probe)
+// Sempre expandida em linha: cada versão abaixo tem o tamanho da janela constante
+static inline __attribute__((always_inline)) void A_send_window_of(int window)
+{
+	struct conn *c = conn();
 
-	A_next_seqnum++;
+	if (c->A_state != ESTABLISHED) // Dados só depois do handshake
+		return;
+	while (c->A_queue.nsent < c->A_queue.count && c->A_queue.nsent < window && c->A_queue.nsent < c->A_rwnd)
+		A_send_next();
 
-	if (A_baseWindow == NULL) // Se for o primeiro pacote a ser enviado
+	if (c->A_queue.count > 0 && c->A_queue.nsent == 0 && !c->A_persist)
 	{
-		A_baseWindow = newElement;
-		A_endWindow = newElement;
-		send_packet(A, packet);
+		c->A_persist = 1;
+		starttimer(A, c->A_probe);
 	}
-	else // Se não, adiciona na fila
+}
+
+// Versões de A_send_window especializadas em tempo de compilação para as janelas
+// mais comuns nas varreduras, e a genérica, que lê window_size. main() escolhe uma
+// delas com -N, sem precisar recompilar para cada janela
+#define SEND_WINDOW(N)          \
+	void A_send_window_##N(void) \
+	{                            \
+		A_send_window_of(N);     \
+	}
+SEND_WINDOW(1)
+SEND_WINDOW(32)
+SEND_WINDOW(1024)
+
+void A_send_window_default(void)
+{
+	A_send_window_of(WINDOWSIZE);
+}
+
+void A_send_window_any(void)
+{
+	A_send_window_of(window_size);
+}
+
+struct
+{
+	int size;
+	void (*send_window)(void);
+} send_windows[] = {
+	{WINDOWSIZE, A_send_window_default},
+	{1, A_send_window_1},
+	{32, A_send_window_32},
+	{1024, A_send_window_1024},
+};
+
+void (*A_send_window)(void) = A_send_window_default;
+
+// Escolhe a versão de A_send_window para a janela size; 0 se size não cabe no
+// espaço de sequência
+int window_select(int size)
+{
+	if (size < 1 || (unsigned long long)size >= (1ULL << (SEQBITS - 1)))
+		return 0;
+	window_size = size;
+	A_send_window = A_send_window_any;
+	for (int i = 0; i < (int)(sizeof(send_windows) / sizeof(send_windows[0])); i++)
+		if (send_windows[i].size == size)
+		{
+			A_send_window = send_windows[i].send_window;
+			break;
+		}
+	return 1;
+}
+
+// Reenvia os pacotes em voo de A que cabem na janela anunciada por B, religando o timer
+void A_resend_window(void)
+{
+	struct conn *c = conn();
+	struct pkt packet;
+
+	starttimer(A, TIMEOUT);
+	for (int i = 0; i < c->A_queue.nsent && i < c->A_rwnd; i++)
+	{
+		queue_packet(&c->A_queue, i, &packet);
+		send_packet(A, &packet, 1);
+	}
+}
+
+// Janela de B zerada: só o primeiro pacote da fila vai, como sonda, e a espera
+// pela próxima dobra, até PROBE_MAX, até que B anuncie espaço outra vez
+void A_send_probe(void)
+{
+	struct conn *c = conn();
+	struct pkt packet;
+
+	printf("(Sonda de janela zero)\n");
+	if (c->A_queue.nsent == 0) // Nada em voo: a sonda é a primeira vez do pacote
+	{
+		queue_packet(&c->A_queue, c->A_queue.nsent++, &packet);
+		c->A_send_seqnum = seq_next(c->A_send_seqnum);
+		send_packet(A, &packet, 0);
+	}
+	else
 	{
-		A_endWindow->next = newElement;
+		queue_packet(&c->A_queue, 0, &packet);
+		send_packet(A, &packet, 1);
 	}
+	starttimer(A, c->A_probe);
+	if (c->A_probe < PROBE_MAX)
+		c->A_probe *= 2;
+}
+
+// A aplicação abre uma conexão (-C): handshake de três vias, começando pelo SYN
+void A_open(void)
+{
+	struct conn *c = conn();
+
+	printf("[A] Abrindo conexão.\n");
+	queue_clear(&c->A_queue);
+	c->A_isn = choose_isn(A);
+	c->A_next_seqnum = seq_next(c->A_isn);
+	c->A_send_seqnum = c->A_next_seqnum;
+	c->A_persist = 0;
+	c->A_probe = TIMEOUT;
+	c->A_closing = 0;
+	c->A_state = SYN_SENT;
+	send_control(A, c->A_isn, 0, SYN);
+	starttimer(A, TIMEOUT);
+}
+
+// Envia o FIN de A, que ocupa o seqnum seguinte ao último pacote de dados
+void A_send_fin(void)
+{
+	struct conn *c = conn();
+
+	c->A_closing = 0;
+	c->A_fin = c->A_send_seqnum;
+	c->A_state = FIN_WAIT;
+	send_control(A, c->A_fin, 0, FIN);
+	starttimer(A, TIMEOUT);
+}
+
+// A aplicação fecha a conexão (-C): o FIN espera os ACKs dos pacotes já enviados
+void A_close(void)
+{
+	struct conn *c = conn();
+
+	printf("[A] Fechando conexão.\n");
+	c->A_closing = 1;
+	if (c->A_state == ESTABLISHED && c->A_queue.count == 0)
+		A_send_fin();
+}
+
+// Mensagem que veio de cima, envia para baixo...
+// Recebe mensagem e envia um pacote para B
+void A_output(struct msg message)
+{
+	struct conn *c = conn();
+
+	printf("[A] Mensagem recebida.\n");
+
+	queue_push(&c->A_queue, c->A_next_seqnum, message.data);
+	c->A_next_seqnum = seq_next(c->A_next_seqnum);
+
+	A_send_window();
 }
 
 void B_output(struct msg message) /* need be completed only for extra credit */
@@ -170,10 +482,9 @@ void B_output(struct msg message) /* need be completed only for extra credit */
 // Recebe um pacote e envia uma mensagem
 void A_input(struct pkt packet)
 {
-	printf("[A] Pacote recebido. ");
+	struct conn *c = conn();
 
-	if (packet.seqnum != A_expect_seqnum)
-		return printf("(descartado)\n"); // Pacote é descartado (fora de ordem), timeout de B irá disparar
+	printf("[A] Pacote recebido. ");
 
 	int local_checksum = calc_checksum(&packet);
 
@@ -181,49 +492,149 @@ void A_input(struct pkt packet)
 	if (local_checksum != packet.checksum)
 		return; // pacote é ignorado, timeout do outro lado irá disparar
 
+	if (is_control(&packet, SYNACK)) // Resposta de B ao SYN
+	{
+		printf("(SYNACK)\n");
+		if (packet.acknum != c->A_isn) // De outra conexão
+			return;
+
+		// Confirma o SYNACK, mesmo repetido: B o reenvia se o ACK se perdeu
+		send_ack(A, packet.seqnum);
+		if (c->A_state != SYN_SENT)
+			return;
+		stoptimer(A);
+		c->A_state = ESTABLISHED;
+		c->A_rwnd = packet.rwnd;
+		connected(A);
+		A_send_window();
+		return;
+	}
+	if (is_control(&packet, FINACK)) // Resposta de B ao FIN
+	{
+		printf("(FINACK)\n");
+		if (packet.acknum != c->A_fin)
+			return;
+
+		// Confirma o FINACK, mesmo repetido, e espera em TIME_WAIT que B o receba
+		send_ack(A, packet.seqnum);
+		if (c->A_state != FIN_WAIT)
+			return;
+		stoptimer(A);
+		c->A_state = TIME_WAIT;
+		starttimer(A, 2 * MSL);
+		return;
+	}
+
 	if (strncmp(packet.payload, ACK, strlen(ACK)) == 0) // Pacote é um ACK
 	{
 		printf("(ACK)\n");
+		if (c->A_state != ESTABLISHED) // Só há dados em voo com a conexão estabelecida
+			return;
 
-		if (packet.acknum <= A_endWindow->packet->seqnum) // Verifica se o ACKNUM é válido
+		// A janela anunciada vale mesmo para ACKs repetidos, que podem ser atualizações de janela
+		int reopened = c->A_rwnd == 0 && packet.rwnd > 0;
+		c->A_rwnd = packet.rwnd;
+		if (packet.rwnd > 0) // B tem espaço: a próxima janela zero começa com sondas espaçadas de TIMEOUT
+			c->A_probe = TIMEOUT;
+
+		// Verifica se o ACKNUM está dentro da janela em voo [base, send)
+		// Se o ACKNUM não for válido, é ignorado e o timeout vai disparar
+		if (c->A_queue.count == 0 ||
+			!seq_in_window(packet.acknum, c->A_queue.seqnum[c->A_queue.head], c->A_send_seqnum))
 		{
-			// Ajusta a base de envio da janela para o próximo pacote
-			A_last_ack = &packet;
-			A_baseWindow = A_baseWindow->next;
+			if (!reopened)
+				return;
+
+			// Atualização de janela: desliga o persist timer, ou reenvia a sonda que B descartou
+			// e o mais que estiver em voo, só até onde cabe na janela reaberta
 			stoptimer(A);
+			c->A_persist = 0;
+			if (c->A_queue.nsent > 0)
+				A_resend_window();
+			A_send_window();
+			return;
 		}
-		else return;
-		// Se o ACKNUM não for válido, é ignorado e o timeout vai disparar
+
+		// ACK cumulativo: a base avança até depois do ACKNUM, de uma vez, já que
+		// os seqnums da fila são consecutivos
+		int nacked = seq_diff(packet.acknum, c->A_queue.seqnum[c->A_queue.head]) + 1;
+		queue_pop(&c->A_queue, nacked);
+		acked(A, nacked); // Devolve os créditos à aplicação
+
+		// Reinicia o timer se ainda houver pacotes em voo
+		stoptimer(A);
+		c->A_persist = 0;
+		if (c->A_queue.nsent > 0)
+			starttimer(A, TIMEOUT);
+
+		// Fechamento pedido e tudo confirmado: envia o FIN
+		if (c->A_closing && c->A_queue.count == 0)
+			A_send_fin();
+		else
+			A_send_window();
 	}
 	else // Se não for um ACK
 	{
+		// Pacote fora de ordem é descartado; o ACK do último em ordem é repetido, senão a
+		// perda desse ACK deixaria B reenviando para sempre um pacote já entregue
+		if (packet.seqnum != c->A_expect_seqnum)
+		{
+			printf("(descartado)\n");
+			send_ack(A, seq_prev(c->A_expect_seqnum));
+			return;
+		}
+
+		// Buffer de recepção cheio: descarta e responde com a janela zerada
+		if (getrwnd(A) == 0)
+		{
+			printf("(buffer cheio)\n");
+			send_ack(A, seq_prev(c->A_expect_seqnum));
+			return;
+		}
+
 		printf("(MSG)\n");
 
-		// Envia mensagem para a camada de cima...
-		send_ack(A, &packet);
+		// Envia mensagem para a camada de cima, depois o ACK com o espaço que sobrou...
 		tolayer5(A, packet.payload);
-	}
+		send_ack(A, packet.seqnum);
 
-	// Ajusta o próximo seqnum esperado
-	A_expect_seqnum = packet.seqnum + 1;
+		// Ajusta o próximo seqnum esperado
+		c->A_expect_seqnum = seq_next(packet.seqnum);
+	}
 }
 
 // Timeout de A
 void A_timerinterrupt(void)
 {
+	struct conn *c = conn();
+
 	printf("[A] Timeout. ");
-	struct window *current_window;
 
+	// SYN ou FIN sem resposta: reenvia
+	if (c->A_state == SYN_SENT || c->A_state == FIN_WAIT)
+	{
+		printf("(Reenviando %s)\n", c->A_control.payload);
+		starttimer(A, TIMEOUT);
+		tolayer3(A, c->A_control);
+	}
+	else if (c->A_state == TIME_WAIT) // Fim do TIME_WAIT: a conexão está fechada
+	{
+		printf("(Conexão fechada)\n");
+		c->A_state = CLOSED;
+		closed(A);
+	}
+	// Janela de B zerada, com pacotes em voo ou com o persist timer: uma sonda só,
+	// nunca a janela inteira, já que B descartaria o resto
+	else if (c->A_rwnd == 0 && c->A_queue.count > 0)
+	{
+		c->A_persist = 0;
+		A_send_probe();
+	}
 	// Verifica se há pacotes que não receberam ACK
-	if (A_last_ack == NULL || (A_last_ack->acknum <= A_endWindow->packet->seqnum))
+	else if (c->A_queue.nsent > 0)
 	{
 		printf("(Reenviando pacotes)\n");
-		current_window = A_baseWindow;
-		while (current_window != NULL)
-		{
-			send_packet(A, current_window->packet);
-			current_window = current_window->next;
-		}
+		A_resend_window();
 	}
 	else
 		printf("\n");
@@ -232,23 +643,85 @@ void A_timerinterrupt(void)
 // Inicializa o A
 void A_init(void)
 {
-	A_baseWindow = NULL;
-	A_endWindow = NULL;
-	A_last_ack = NULL;
-	A_expect_seqnum = 0;
-	A_next_seqnum = 0;
+	struct conn *c = conn();
+
+	queue_clear(&c->A_queue);
+	c->A_expect_seqnum = 0;
+	c->A_next_seqnum = 0;
+	c->A_send_seqnum = 0;
+	c->A_rwnd = getrwnd(A); // Até o primeiro ACK, supõe em B um buffer de recepção igual ao de A
+	c->A_persist = 0;
+	c->A_probe = TIMEOUT;
+	c->A_state = ESTABLISHED;
+	c->A_closing = 0;
 }
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
 
+// B recebe um SYN: aceita a conexão e responde com o SYNACK
+void B_syn(struct pkt *packet)
+{
+	struct conn *c = conn();
+
+	// SYN repetido da conexão atual: reenvia o SYNACK se A ainda não o confirmou
+	if (packet->seqnum == c->B_peer_isn && c->B_state != CLOSED)
+	{
+		if (c->B_state == SYN_RCVD)
+			tolayer3(B, c->B_control);
+		return;
+	}
+
+	// Nova conexão; em LAST_ACK, o ACK final se perdeu e A já está na seguinte
+	if (c->B_state == SYN_RCVD || c->B_state == LAST_ACK)
+		stoptimer(B);
+	if (c->B_state == LAST_ACK)
+		closed(B);
+	c->B_peer_isn = packet->seqnum;
+	c->B_expect_seqnum = seq_next(packet->seqnum);
+	c->B_isn = choose_isn(B);
+	c->B_state = SYN_RCVD;
+	send_control(B, c->B_isn, packet->seqnum, SYNACK);
+	starttimer(B, TIMEOUT);
+}
+
+// A confirmou o SYNACK, com o ACK ou com o primeiro pacote de dados
+void B_established(void)
+{
+	struct conn *c = conn();
+
+	stoptimer(B);
+	c->B_state = ESTABLISHED;
+	connected(B);
+}
+
+// B recebe um FIN: confirma e fecha o seu lado junto, com o FINACK
+void B_fin(struct pkt *packet)
+{
+	struct conn *c = conn();
+
+	// FIN repetido: o FINACK se perdeu
+	if (c->B_state == LAST_ACK && packet->seqnum == seq_prev(c->B_expect_seqnum))
+	{
+		tolayer3(B, c->B_control);
+		return;
+	}
+	// FIN fora de ordem é ignorado, timeout de A irá disparar
+	if (c->B_state != ESTABLISHED || packet->seqnum != c->B_expect_seqnum)
+		return;
+
+	c->B_expect_seqnum = seq_next(packet->seqnum);
+	c->B_state = LAST_ACK;
+	send_control(B, seq_next(c->B_isn), packet->seqnum, FINACK);
+	starttimer(B, TIMEOUT);
+}
+
 // Pacote recebido da camada 3 que vai para cima...
 // Recebe um pacote e envia uma mensagem
 void B_input(struct pkt packet)
 {
-	printf("[B] Pacote recebido. ");
+	struct conn *c = conn();
 
-	if (packet.seqnum != B_expect_seqnum)
-		return printf("(descartado)\n"); // Pacote é descartado (fora de ordem), timeout de A irá disparar
+	printf("[B] Pacote recebido. ");
 
 	// Verifica checksum do pacote
 	int local_checksum = calc_checksum(&packet);
@@ -256,459 +729,229 @@ void B_input(struct pkt packet)
 	if (local_checksum != packet.checksum)
 		return; // pacote é ignorado, timeout do outro lado irá disparar
 
+	if (is_control(&packet, SYN))
+	{
+		printf("(SYN)\n");
+		B_syn(&packet);
+		return;
+	}
+	if (is_control(&packet, FIN))
+	{
+		printf("(FIN)\n");
+		B_fin(&packet);
+		return;
+	}
+
 	if (strncmp(packet.payload, ACK, strlen(ACK)) == 0) // Pacote é um ACK (não usado aqui)
 	{
 		printf("(ACK)\n");
 
-		if (packet.acknum <= B_endWindow->packet->seqnum) // Verifica se o ACKNUM é válido
+		// ACK do SYNACK: conexão estabelecida; ACK do FINACK: conexão fechada
+		if (c->B_state == SYN_RCVD && packet.acknum == c->B_isn)
 		{
-			// Ajuda a base de envio da janela para o próximo pacote
-			B_last_ack = &packet;
-			B_baseWindow = B_baseWindow->next;
+			B_established();
+			return;
 		}
-		else return;
+		if (c->B_state == LAST_ACK && packet.acknum == seq_next(c->B_isn))
+		{
+			stoptimer(B);
+			c->B_state = CLOSED;
+			closed(B);
+			return;
+		}
+
+		// Verifica se o ACKNUM é válido
 		// Se o ACKNUM não for válido, é ignorado
+		if (c->B_queue.count == 0 ||
+			!seq_in_window(packet.acknum, c->B_queue.seqnum[c->B_queue.head], c->B_next_seqnum))
+			return;
+
+		// Ajusta a base de envio da janela para o próximo pacote
+		queue_pop(&c->B_queue, 1);
 	}
 	else // Se não for um ACK
 	{
+		// Dados em ordem também confirmam o SYNACK, se o ACK de A se perdeu
+		if (c->B_state == SYN_RCVD && packet.seqnum == c->B_expect_seqnum)
+			B_established();
+
+		// Pacote fora de ordem é descartado; o ACK do último em ordem é repetido, senão a
+		// perda desse ACK deixaria A reenviando para sempre um pacote já entregue
+		if (packet.seqnum != c->B_expect_seqnum)
+		{
+			printf("(descartado)\n");
+			send_ack(B, seq_prev(c->B_expect_seqnum));
+			return;
+		}
+
+		// Buffer de recepção cheio: descarta e responde à sonda com a janela zerada
+		if (getrwnd(B) == 0)
+		{
+			printf("(buffer cheio)\n");
+			send_ack(B, seq_prev(c->B_expect_seqnum));
+			return;
+		}
+
 		printf("(MSG)\n");
 
-		// Envia mensagem para a camada de cima e envia um ACK para outro lado...
-		send_ack(B, &packet);
+		// Envia mensagem para a camada de cima e envia um ACK com o espaço que sobrou...
 		tolayer5(B, packet.payload);
-	}
+		send_ack(B, packet.seqnum);
 
-	// Ajusta o próximo seqnum esperado
-	B_expect_seqnum = packet.seqnum + 1;
+		// Ajusta o próximo seqnum esperado
+		c->B_expect_seqnum = seq_next(packet.seqnum);
+	}
 }
 
-// Timeout de B (não usado)
+// Timeout de B: reenvia o SYNACK ou o FINACK que A ainda não confirmou
 void B_timerinterrupt(void)
 {
-}
+	struct conn *c = conn();
 
-// Inicializa B
-void B_init(void)
-{
-	B_baseWindow = NULL;
-	B_endWindow = NULL;
-	B_last_ack = NULL;
-	B_expect_seqnum = 0;
-	B_next_seqnum = 0;
+	printf("[B] Timeout. ");
+	if (c->B_state == SYN_RCVD || c->B_state == LAST_ACK)
+	{
+		printf("(Reenviando %s)\n", c->B_control.payload);
+		starttimer(B, TIMEOUT);
+		tolayer3(B, c->B_control);
+	}
+	else
+		printf("\n");
 }
 
-// *******************************************************************************
-// *******************************************************************************
-// ************ Final do código modificado
-// *******************************************************************************
-// *******************************************************************************
+// A aplicação esvaziou metade do buffer de recepção de B, que estava cheio:
+// avisa A com um ACK repetido que anuncia a nova janela (window update)
+void B_windowupdate(void)
+{
+	struct conn *c = conn();
 
-/*****************************************************************
-***************** NETWORK EMULATION CODE STARTS BELOW ***********
-The code below emulates the layer 3 and below network environment:
-  - emulates the tranmission and delivery (possibly with bit-level corruption
-    and packet loss) of packets across the layer 3/4 interface
-  - handles the starting/stopping of a timer, and generates timer
-    interrupts (resulting in calling students timer handler).
-  - generates message to be sent (passed from later 5 to 4)
-
-THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-the emulator, you're welcome to look at the code - but again, you should have
-to, and you defeinitely should not have to modify
-******************************************************************/
-
-struct event
-{
-	float evtime;		/* event time */
-	int evtype;			/* event type code */
-	int eventity;		/* entity where event occurs */
-	struct pkt *pktptr; /* ptr to packet (if any) assoc w/ this event */
-	struct event *prev;
-	struct event *next;
-};
-struct event *evlist = NULL; /* the event list */
-
-// initialize globals
-int TRACE = 1;	 /* for my debugging */
-int nsim = 0;	 /* number of messages from 5 to 4 so far */
-int nsimmax = 0; /* number of msgs to generate, then stop */
-float time = 0.000;
-float lossprob;	   /* probability that a packet is dropped  */
-float corruptprob; /* probability that one bit is packet is flipped */
-float lambda;	   /* arrival rate of messages from layer 5 */
-int ntolayer3;	   /* number sent into layer 3 */
-int nlost;		   /* number lost in media */
-int ncorrupt;	   /* number corrupted by media*/
+	printf("[B] Atualização de janela.\n");
+	send_ack(B, seq_prev(c->B_expect_seqnum));
+}
 
-int main(int argc, char *argv[])
+// Inicializa B
+void B_init(void)
 {
-	struct event *eventptr;
-	struct msg msg2give;
-	struct pkt pkt2give;
+	struct conn *c = conn();
 
-	int i, j;
-	//   char c;
+	queue_clear(&c->B_queue);
+	c->B_expect_seqnum = 0;
+	c->B_next_seqnum = 0;
+	c->B_state = ESTABLISHED;
+}
 
-	init();
-	A_init();
-	B_init();
+// Guarda (-k) ou restaura (-K) os pacotes de uma fila, a partir da base. Na restauração
+// os vetores lidos com a conexão não valem mais, e o anel é refeito do tamanho da fila
+void checkpoint_queue(int restoring, struct queue *q)
+{
+	struct queue saved = *q;
 
-	while (1)
+	if (restoring)
 	{
-		eventptr = evlist; /* get next event to simulate */
-		if (eventptr == NULL)
-			goto terminate;
-		evlist = evlist->next; /* remove this event from event list */
-		if (evlist != NULL)
-			evlist->prev = NULL;
-		if (TRACE >= 2)
-		{
-			printf("\nEVENT time: %f,", eventptr->evtime);
-			printf("  type: %d", eventptr->evtype);
-			if (eventptr->evtype == 0)
-				printf(", timerinterrupt  ");
-			else if (eventptr->evtype == 1)
-				printf(", fromlayer5 ");
-			else
-				printf(", fromlayer3 ");
-			printf(" entity: %d\n", eventptr->eventity);
-		}
-		time = eventptr->evtime; /* update time to next event time */
-		if (nsim == nsimmax)
-			break; /* all done with simulation */
-		if (eventptr->evtype == FROM_LAYER5)
-		{
-			generate_next_arrival(); /* set up future arrival */
-			/* fill in msg to give with string of same letter */
-			j = nsim % 26;
-			for (i = 0; i < 20; i++)
-				msg2give.data[i] = 97 + j;
-			if (TRACE > 2)
-			{
-				printf("          MAINLOOP: data given to student: ");
-				for (i = 0; i < 20; i++)
-					printf("%c", msg2give.data[i]);
-				printf("\n");
-			}
-			nsim++;
-			if (eventptr->eventity == A)
-				A_output(msg2give);
-			else
-				B_output(msg2give);
-		}
-		else if (eventptr->evtype == FROM_LAYER3)
-		{
-			pkt2give.seqnum = eventptr->pktptr->seqnum;
-			pkt2give.acknum = eventptr->pktptr->acknum;
-			pkt2give.checksum = eventptr->pktptr->checksum;
-			for (i = 0; i < 20; i++)
-				pkt2give.payload[i] = eventptr->pktptr->payload[i];
-			if (eventptr->eventity == A) /* deliver packet by calling */
-				A_input(pkt2give);		 /* appropriate entity */
-			else
-				B_input(pkt2give);
-			free(eventptr->pktptr); /* free the memory for packet */
-		}
-		else if (eventptr->evtype == TIMER_INTERRUPT)
-		{
-			if (eventptr->eventity == A)
-				A_timerinterrupt();
-			else
-				B_timerinterrupt();
-		}
-		else
+		q->size = q->head = q->count = 0;
+		q->seqnum = q->checksum = NULL;
+		q->payload = NULL;
+		for (int i = 0; i < saved.count; i++)
 		{
-			printf("INTERNAL PANIC: unknown event type \n");
+			int seqnum;
+			char data[MSGSIZE];
+
+			checkpoint_data(&seqnum, sizeof(seqnum));
+			checkpoint_data(data, MSGSIZE);
+			queue_push(q, seqnum, data);
 		}
-		free(eventptr);
+		q->nsent = saved.nsent;
+		return;
 	}
-
-terminate:
-	printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n", time, nsim);
-	return 0;
-}
-
-init() /* initialize the simulator */
-{
-	int i;
-	float sum, avg;
-	float jimsrand();
-
-	printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-	printf("Enter the number of messages to simulate: ");
-	scanf("%d", &nsimmax);
-	printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-	scanf("%f", &lossprob);
-	printf("Enter packet corruption probability [0.0 for no corruption]:");
-	scanf("%f", &corruptprob);
-	printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-	scanf("%f", &lambda);
-	printf("Enter TRACE:");
-	scanf("%d", &TRACE);
-
-	srand(9999); /* init random number generator */
-	sum = 0.0;	 /* test random number generator for students */
-	for (i = 0; i < 1000; i++)
-		sum = sum + jimsrand(); /* jimsrand() should be uniform in [0,1] */
-	avg = sum / 1000.0;
-	if (avg < 0.25 || avg > 0.75)
+	for (int i = 0; i < q->count; i++)
 	{
-		printf("It is likely that random number generation on your machine\n");
-		printf("is different from what this emulator expects.  Please take\n");
-		printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-		exit(1);
-	}
-
-	ntolayer3 = 0;
-	nlost = 0;
-	ncorrupt = 0;
-
-	time = 0.0;				 /* initialize time to 0.0 */
-	generate_next_arrival(); /* initialize event list */
-}
-
-/****************************************************************************/
-/* jimsrand(): return a float in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
-/****************************************************************************/
-float jimsrand(void)
-{
-	double mmm = 2147483647;   /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-	float x;				   /* individual students may need to change mmm */
-	x = (float)(rand() / mmm); /* x should be uniform in [0,1] */
-	return (x);
-}
-
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
-
-void generate_next_arrival(void)
-{
-	double x, log(), ceil();
-	struct event *evptr;
-	char *p = malloc(1);
-	//   float ttime;
-	//   int tempint;
+		int slot = queue_slot(q, i);
 
-	if (TRACE > 2)
-		printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
-
-	x = lambda * jimsrand() * 2; /* x is uniform on [0,2*lambda] */
-								 /* having mean of lambda        */
-	evptr = (struct event *)malloc(sizeof(struct event));
-	evptr->evtime = (float)(time + x);
-	evptr->evtype = FROM_LAYER5;
-	if (BIDIRECTIONAL && (jimsrand() > 0.5))
-		evptr->eventity = B;
-	else
-		evptr->eventity = A;
-	insertevent(evptr);
+		checkpoint_data(&q->seqnum[slot], sizeof(int));
+		checkpoint_data(q->payload[slot], MSGSIZE);
+	}
 }
 
-void insertevent(struct event *p)
+// Guarda (-k) ou restaura (-K) o estado de todos os fluxos
+void checkpoint_conns(int restoring)
 {
-	struct event *q, *qold;
+	int size = window_size;
 
-	if (TRACE > 2)
+	checkpoint_data(&size, sizeof(size)); // A simulação só segue igual com a mesma janela
+	if (size != window_size)
 	{
-		printf("            INSERTEVENT: time is %lf\n", time);
-		printf("            INSERTEVENT: future time will be %lf\n", p->evtime);
-	}
-	q = evlist; /* q points to header of list in which p struct inserted */
-	if (q == NULL)
-	{ /* list is empty */
-		evlist = p;
-		p->next = NULL;
-		p->prev = NULL;
+		fprintf(stderr, "gbn: o checkpoint usa a janela %d, não %d\n", size, window_size);
+		exit(1);
 	}
-	else
+	for (int f = 0; f < getnflows(); f++)
 	{
-		for (qold = q; q != NULL && p->evtime > q->evtime; q = q->next)
-			qold = q;
-		if (q == NULL)
-		{ /* end of list */
-			qold->next = p;
-			p->prev = qold;
-			p->next = NULL;
-		}
-		else if (q == evlist)
-		{ /* front of list */
-			p->next = evlist;
-			p->prev = NULL;
-			p->next->prev = p;
-			evlist = p;
-		}
-		else
-		{ /* middle of list */
-			p->next = q;
-			p->prev = q->prev;
-			q->prev->next = p;
-			q->prev = p;
-		}
-	}
-}
+		struct conn *c = &conns[f];
 
-void printevlist(void)
-{
-	struct event *q;
-	//  int i;
-	printf("--------------\nEvent List Follows:\n");
-	for (q = evlist; q != NULL; q = q->next)
-	{
-		printf("Event time: %f, type: %d entity: %d\n", q->evtime, q->evtype, q->eventity);
+		checkpoint_data(c, sizeof(struct conn)); // Os pacotes das filas vêm a seguir
+		checkpoint_queue(restoring, &c->A_queue);
+		checkpoint_queue(restoring, &c->B_queue);
 	}
-	printf("--------------\n");
 }
 
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
-/* A or B is trying to stop timer */
-{
-	struct event *q; //,*qold;
-
-	if (TRACE > 2)
-		printf("          STOP TIMER: stopping timer at %f\n", time);
-	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-	for (q = evlist; q != NULL; q = q->next)
-		if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
-		{
-			/* remove this event */
-			if (q->next == NULL && q->prev == NULL)
-				evlist = NULL;		  /* remove first and only event on list */
-			else if (q->next == NULL) /* end of list - there is one in front */
-				q->prev->next = NULL;
-			else if (q == evlist)
-			{ /* front of list - there must be event after */
-				q->next->prev = NULL;
-				evlist = q->next;
-			}
-			else
-			{ /* middle of list */
-				q->next->prev = q->prev;
-				q->prev->next = q->next;
-			}
-			free(q);
-			return;
-		}
-	printf("Warning: unable to cancel your timer. It wasn't running.\n");
-}
+// *******************************************************************************
+// *******************************************************************************
+// ************ Final do código modificado
+// *******************************************************************************
+// *******************************************************************************
 
-void starttimer(int AorB, float increment)
-/* A or B is trying to stop timer */
+struct protocol gbn_protocol = {
+	.name = "gbn",
+	.bidirectional = 0, /* change to 1 if you're doing extra credit */
+						/* and complete B_output */
+	.A_output = A_output,
+	.A_input = A_input,
+	.A_timerinterrupt = A_timerinterrupt,
+	.A_init = A_init,
+	.B_output = B_output,
+	.B_input = B_input,
+	.B_timerinterrupt = B_timerinterrupt,
+	.B_init = B_init,
+	.B_windowupdate = B_windowupdate,
+	.A_open = A_open,
+	.A_close = A_close,
+	.checkpoint = checkpoint_conns,
+};
 
+// gbn [opções do emulador] [-N janela]
+// -N (ou -Njanela) vale em qualquer posição antes de "--" e é tirado de argv; as
+// outras opções seguem para o emulador como se -N não existisse
+int main(int argc, char *argv[])
 {
+	int n = 1, i;
 
-	struct event *q;
-	struct event *evptr;
-	char *p = malloc(1);
+	for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+	{
+		char *size;
 
-	if (TRACE > 2)
-		printf("          START TIMER: starting timer at %f\n", time);
-	/* be nice: check to see if timer is already started, if so, then  warn */
-	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-	for (q = evlist; q != NULL; q = q->next)
-		if ((q->evtype == TIMER_INTERRUPT && q->eventity == AorB))
+		if (strcmp(argv[i], "-N") == 0)
 		{
-			printf("Warning: attempt to start a timer that is already started\n");
-			return;
+			if (i + 1 == argc)
+			{
+				fprintf(stderr, "%s: -N pede o tamanho da janela\n", argv[0]);
+				return 1;
+			}
+			size = argv[++i];
 		}
-
-	/* create future event for when timer goes off */
-	evptr = (struct event *)malloc(sizeof(struct event));
-	evptr->evtime = time + increment;
-	evptr->evtype = TIMER_INTERRUPT;
-	evptr->eventity = AorB;
-	insertevent(evptr);
-}
-
-/************************** TOLAYER3 ***************/
-tolayer3(AorB, packet) int AorB; /* A or B is trying to stop timer */
-struct pkt packet;
-{
-	struct pkt *mypktptr;
-	struct event *evptr, *q;
-	//  char *malloc();
-	float lastime, x, jimsrand();
-	int i;
-
-	ntolayer3++;
-
-	/* simulate losses: */
-	if (jimsrand() < lossprob)
-	{
-		nlost++;
-		if (TRACE > 0)
-			printf("          TOLAYER3: packet being lost\n");
-		return;
-	}
-
-	/* make a copy of the packet student just gave me since he/she may decide */
-	/* to do something with the packet after we return back to him/her */
-	mypktptr = (struct pkt *)malloc(sizeof(struct pkt));
-	mypktptr->seqnum = packet.seqnum;
-	mypktptr->acknum = packet.acknum;
-	mypktptr->checksum = packet.checksum;
-	for (i = 0; i < 20; i++)
-		mypktptr->payload[i] = packet.payload[i];
-	if (TRACE > 2)
-	{
-		printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-			   mypktptr->acknum, mypktptr->checksum);
-		for (i = 0; i < 20; i++)
-			printf("%c", mypktptr->payload[i]);
-		printf("\n");
-	}
-
-	/* create future event for arrival of packet at the other side */
-	evptr = (struct event *)malloc(sizeof(struct event));
-	evptr->evtype = FROM_LAYER3;	  /* packet will pop out from layer3 */
-	evptr->eventity = (AorB + 1) % 2; /* event occurs at other entity */
-	evptr->pktptr = mypktptr;		  /* save ptr to my copy of packet */
-									  /* finally, compute the arrival time of packet at the other end.
-   medium can not reorder, so make sure packet arrives between 1 and 10
-   time units after the latest arrival time of packets
-   currently in the medium on their way to the destination */
-	lastime = time;
-	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-	for (q = evlist; q != NULL; q = q->next)
-		if ((q->evtype == FROM_LAYER3 && q->eventity == evptr->eventity))
-			lastime = q->evtime;
-	evptr->evtime = lastime + 1 + 9 * jimsrand();
-
-	/* simulate corruption: */
-	if (jimsrand() < corruptprob)
-	{
-		ncorrupt++;
-		if ((x = jimsrand()) < .75)
-			mypktptr->payload[0] = 'Z'; /* corrupt payload */
-		else if (x < .875)
-			mypktptr->seqnum = 999999;
+		else if (strncmp(argv[i], "-N", 2) == 0 && argv[i][2] != '\0')
+			size = argv[i] + 2;
 		else
-			mypktptr->acknum = 999999;
-		if (TRACE > 0)
-			printf("          TOLAYER3: packet being corrupted\n");
+		{
+			argv[n++] = argv[i];
+			continue;
+		}
+		if (!window_select(atoi(size)))
+		{
+			fprintf(stderr, "%s: janela %s fora do espaço de sequência\n", argv[0], size);
+			return 1;
+		}
 	}
-
-	if (TRACE > 2)
-		printf("          TOLAYER3: scheduling arrival on other side\n");
-	insertevent(evptr);
+	while (i < argc)
+		argv[n++] = argv[i++];
+	argv[n] = NULL;
+	return emulator_main(&gbn_protocol, n, argv);
 }
-
-tolayer5(AorB, datasent) int AorB;
-char datasent[20];
-{
-	int i;
-	if (TRACE > 2)
-	{
-		printf("          TOLAYER5: data received: ");
-		for (i = 0; i < 20; i++)
-			printf("%c", datasent[i]);
-		printf("\n");
-	}
-}
\ No newline at end of file